@@ -1,9 +1,169 @@
 #include "benchmark.h"
 #include <stdio.h>
+#include <string.h>
+
+#ifdef TSC_BINARY
+    // bypass putchar(), which expands '\n' into "\r\n"
+    #ifdef NSANCUS_COMPILE
+        #define TSC_PUT_BYTE(b)     putchar(b)
+    #else
+        #include <sancus_support/uart.h>
+        #define TSC_PUT_BYTE(b)     uart_write_byte(b)
+    #endif
+#endif
 
 tsc_t the_ts1, the_ts2, the_diff;
 
+tsc_t tsc_read_overhead = TSC_READ_OVERHEAD;
+int tsc_nb_warmup = TSC_NB_WARMUP;
+int tsc_nb_reps = TSC_NB_REPS;
+
+struct tsc_sample tsc_ring[TSC_RING_SIZE];
+unsigned int tsc_ring_head;
+unsigned long tsc_nb_samples;
+
+// scratch buffer to sort the samples of a single label
+uint32_t tsc_sorted[TSC_RING_SIZE];
+
+#define TSC_RING_IDX(i)         ((i) & (TSC_RING_SIZE - 1))
+#define TSC_PERCENTILE(nb, p)   ((unsigned long) tsc_sorted[((nb) - 1) * (p) / 100])
+
+#ifdef TSC_BINARY
+
+// the label of every id handed out so far; the last id is reused once all are taken
+const char *tsc_labels[TSC_MAX_LABELS];
+unsigned int tsc_nb_labels;
+
+void tsc_put_varint(uint32_t v)
+{
+    while (v >= 0x80)
+    {
+        TSC_PUT_BYTE((v & 0x7f) | 0x80);
+        v >>= 7;
+    }
+    TSC_PUT_BYTE(v);
+}
+
+/*
+ * Returns the id of the label; a new (or evicted) label is defined in the stream
+ */
+unsigned int tsc_label_id(const char *label)
+{
+    unsigned int id;
+    for (id = 0; id < tsc_nb_labels; id++)
+        if (tsc_labels[id] == label || !strcmp(tsc_labels[id], label))
+            return id;
+
+    if (tsc_nb_labels < TSC_MAX_LABELS)
+        id = tsc_nb_labels++;
+    else
+        id = TSC_MAX_LABELS - 1;
+    tsc_labels[id] = label;
+
+    TSC_PUT_BYTE(TSC_TAG_LABEL);
+    tsc_put_varint(id);
+    do
+        TSC_PUT_BYTE(*label);
+    while (*label++);
+    return id;
+}
+
+void tsc_put_sample(const char *label, uint32_t cycles)
+{
+    unsigned int id = tsc_label_id(label);
+    TSC_PUT_BYTE(TSC_TAG_SAMPLE);
+    tsc_put_varint(id);
+    tsc_put_varint(cycles);
+}
+
+void __attribute__((noinline)) print_tsc_diff(char *str)
+{
+    tsc_put_sample(str, (the_diff > UINT32_MAX) ? UINT32_MAX : (uint32_t) the_diff);
+}
+
+void __attribute__((noinline)) tsc_dump(void)
+{
+    unsigned int n = (tsc_nb_samples < TSC_RING_SIZE) ? tsc_nb_samples : TSC_RING_SIZE;
+    unsigned int first = (tsc_nb_samples < TSC_RING_SIZE) ? 0 : tsc_ring_head;
+    unsigned int i;
+
+    for (i = 0; i < n; i++)
+    {
+        struct tsc_sample *s = &tsc_ring[TSC_RING_IDX(first + i)];
+        tsc_put_sample(s->label, s->cycles);
+    }
+    TSC_PUT_BYTE(TSC_TAG_END);
+
+    tsc_reset();
+}
+
+#else // TSC_BINARY
+
 void __attribute__((noinline)) print_tsc_diff(char *str)
 {
     printf("number of cycles for %s is %llu\n", str, the_diff);
 }
+
+void __attribute__((noinline)) tsc_dump(void)
+{
+    unsigned int n = (tsc_nb_samples < TSC_RING_SIZE) ? tsc_nb_samples : TSC_RING_SIZE;
+    unsigned int first = (tsc_nb_samples < TSC_RING_SIZE) ? 0 : tsc_ring_head;
+    unsigned int i, j, k;
+
+    printf("\n%lu tsc samples recorded; aggregating the last %u\n", tsc_nb_samples, n);
+    for (i = 0; i < n; i++)
+    {
+        const char *label = tsc_ring[TSC_RING_IDX(first + i)].label;
+        if (!label)
+            continue;
+
+        // collect all samples of this label in sorted order and mark them done;
+        // identical labels in different compilation units may have distinct addresses
+        unsigned int nb = 0;
+        for (j = i; j < n; j++)
+        {
+            struct tsc_sample *s = &tsc_ring[TSC_RING_IDX(first + j)];
+            if (!s->label || (s->label != label && strcmp(s->label, label)))
+                continue;
+            for (k = nb; k > 0 && tsc_sorted[k - 1] > s->cycles; k--)
+                tsc_sorted[k] = tsc_sorted[k - 1];
+            tsc_sorted[k] = s->cycles;
+            s->label = NULL;
+            nb++;
+        }
+
+        printf("cycles for %s: n=%u min=%lu p50=%lu p90=%lu p99=%lu max=%lu\n",
+            label, nb, TSC_PERCENTILE(nb, 0), TSC_PERCENTILE(nb, 50),
+            TSC_PERCENTILE(nb, 90), TSC_PERCENTILE(nb, 99), TSC_PERCENTILE(nb, 100));
+    }
+
+    tsc_reset();
+}
+
+#endif // TSC_BINARY
+
+void __attribute__((noinline)) tsc_reset(void)
+{
+    unsigned int i;
+    for (i = 0; i < TSC_RING_SIZE; i++)
+        tsc_ring[i].label = NULL;
+    tsc_ring_head = 0;
+    tsc_nb_samples = 0;
+}
+
+void __attribute__((noinline)) tsc_calibrate(void)
+{
+    int i;
+    tsc_t min = (tsc_t) -1;
+    for (i = 0; i < TSC_CALIBRATE_ROUNDS; i++)
+    {
+        the_ts1 = tsc_read();
+        the_ts2 = tsc_read();
+        if (the_ts2 - the_ts1 < min)
+            min = the_ts2 - the_ts1;
+    }
+    tsc_read_overhead = min;
+
+    printf("tsc_read() overhead calibrated to %llu cycles (default %d)\n",
+        tsc_read_overhead, TSC_READ_OVERHEAD);
+}
@@ -5,28 +5,111 @@
  * e.g. TSC1()
  *      some_fct()
  *      TSC2("some_fct")
+ *      ...
+ *      tsc_dump();
+ *
+ * By default, TSC2() only records a (label, cycles) sample in an in-RAM ring;
+ * tsc_dump() prints per label statistics at the end of a benchmark run. Define
+ * TSC_PRINT_EACH to print every measurement right away instead.
+ *
+ * Define TSC_BINARY to emit compact binary records rather than formatted text:
+ * tsc_dump() then streams the raw samples, to be decoded into CSV or JSON on
+ * the host with tsc-decode (see tsc-decode/tsc-decode.c).
+ *
+ * For a distribution rather than a single run, TSC_BENCH() repeats an operation
+ * tsc_nb_reps times after tsc_nb_warmup unrecorded runs:
+ *
+ *      tsc_calibrate();
+ *      TSC_BENCH("some_fct", setup(), some_fct(), teardown());
  */
 #ifndef BENCHMARK_H
+#define BENCHMARK_H
 
 /**
  * @note: make sure tsc_read() is inlined to avoid adding the overhead of exiting
  * the calling SM to enter the tsc_read() function to the measurement
  */
 #include <sancus_support/tsc.h>
+#include <stdint.h>
 
 /**
  * The number of cycles to copy a 64 bit register to a memory location (to be
- * substracted for every measurement)
- * 
+ * substracted for every measurement); the initial value of tsc_read_overhead
+ * until tsc_calibrate() measures the actual overhead
+ *
  * @note: 32 cyles = 8 bytes * 4 cycles/byte
  */
 #define TSC_READ_OVERHEAD       32
 
+// the number of back-to-back tsc_read() pairs of which tsc_calibrate() keeps the min
+#define TSC_CALIBRATE_ROUNDS    16
+
+// the default number of unrecorded and recorded runs for TSC_BENCH()
+#ifndef TSC_NB_WARMUP
+    #define TSC_NB_WARMUP       2
+#endif
+#ifndef TSC_NB_REPS
+    #define TSC_NB_REPS         8
+#endif
+
+/**
+ * The number of samples kept in RAM (a power of two); when the ring is full,
+ * the oldest samples are overwritten
+ */
+#ifndef TSC_RING_SIZE
+    #define TSC_RING_SIZE       256
+#endif
+#if TSC_RING_SIZE & (TSC_RING_SIZE - 1)
+    #error "TSC_RING_SIZE must be a power of two"
+#endif
+
+/**
+ * Binary record stream (TSC_BINARY). Every record starts with a tag byte outside
+ * the ASCII range, such that records can be interleaved with text output;
+ * numbers are unsigned LEB128 varints (7 bits per byte, least significant first,
+ * MSB set on all but the last byte).
+ *
+ *  TSC_TAG_LABEL  <varint id> <label chars> '\0'  (defines or redefines id)
+ *  TSC_TAG_SAMPLE <varint id> <varint cycles>
+ *  TSC_TAG_END                                    (end of a tsc_dump())
+ */
+#define TSC_TAG_LABEL           0xA0
+#define TSC_TAG_SAMPLE          0xA1
+#define TSC_TAG_END             0xA2
+
+// the number of distinct labels that get a stable id in the binary stream
+#ifndef TSC_MAX_LABELS
+    #define TSC_MAX_LABELS      32
+#endif
+
 /**
  * Global unprotected variables to store the intermediate time stamp counts
  */
 extern tsc_t the_ts1, the_ts2, the_diff;
 
+/**
+ * Global unprotected benchmark parameters, adjustable at runtime
+ */
+extern tsc_t tsc_read_overhead;
+extern int tsc_nb_warmup, tsc_nb_reps;
+
+/**
+ * A single measurement; the label string literal's address doubles as its id
+ * and the cycle count saturates at 32 bits
+ */
+struct tsc_sample {
+    const char *label;
+    uint32_t cycles;
+};
+
+/**
+ * Global unprotected sample ring, such that recording a sample from within an
+ * SM is a few stores rather than a call
+ */
+extern struct tsc_sample tsc_ring[TSC_RING_SIZE];
+extern unsigned int tsc_ring_head;
+extern unsigned long tsc_nb_samples;
+
 /**
  * An unprotected function to allow printing the with printf
  *
@@ -35,13 +118,68 @@ extern tsc_t the_ts1, the_ts2, the_diff;
  */
 void __attribute__((noinline)) print_tsc_diff(char *str);
 
+/**
+ * Prints the number of samples and the min, median, 90th and 99th percentile and
+ * max cycle count for every label in the ring; afterwards the ring is empty.
+ * With TSC_BINARY, emits every sample as a binary record instead.
+ */
+void __attribute__((noinline)) tsc_dump(void);
+
+/**
+ * Discards all recorded samples.
+ */
+void __attribute__((noinline)) tsc_reset(void);
+
+/**
+ * Measures the fixed tsc_read() overhead and stores it in tsc_read_overhead,
+ * to be substracted from every subsequent measurement.
+ */
+void __attribute__((noinline)) tsc_calibrate(void);
+
+#define TSC_RECORD(str) \
+    tsc_ring[tsc_ring_head].label = str; \
+    tsc_ring[tsc_ring_head].cycles = (the_diff > UINT32_MAX) ? UINT32_MAX : \
+        (uint32_t) the_diff; \
+    tsc_ring_head = (tsc_ring_head + 1) & (TSC_RING_SIZE - 1); \
+    tsc_nb_samples++;
+
+#ifdef TSC_PRINT_EACH
+    #define TSC_LOG(str)        print_tsc_diff(str);
+#else
+    #define TSC_LOG(str)        TSC_RECORD(str)
+#endif
 
 #define TSC1() \
     the_ts1 = tsc_read();
 
-#define TSC2(str) \
+#define TSC_STOP() \
     the_ts2 = tsc_read(); \
-    the_diff = the_ts2 - the_ts1 - TSC_READ_OVERHEAD; \
-    print_tsc_diff(str);
+    the_diff = the_ts2 - the_ts1 - tsc_read_overhead;
+
+#define TSC2(str) \
+    TSC_STOP() \
+    TSC_LOG(str)
+
+/**
+ * Measures @p(stmt) tsc_nb_reps times after tsc_nb_warmup unrecorded runs;
+ * @p(setup) and @p(teardown) run before and after every measurement, but
+ * are not measured (either may be left empty)
+ */
+#define TSC_BENCH(str, setup, stmt, teardown) \
+do { \
+    int tsc_rep; \
+    for (tsc_rep = -tsc_nb_warmup; tsc_rep < tsc_nb_reps; tsc_rep++) \
+    { \
+        setup; \
+        TSC1() \
+        stmt; \
+        TSC_STOP() \
+        if (tsc_rep >= 0) \
+        { \
+            TSC_LOG(str) \
+        } \
+        teardown; \
+    } \
+} while(0)
 
 #endif
@@ -1,6 +1,6 @@
 #include "common.h"
 
-#ifndef NSANCUS_COMPILE
+#if !defined(NSANCUS_COMPILE) && !defined(SANCUS_HOST)
 int __attribute__((noinline)) putchar(int c)
 {
     if (c == '\n')
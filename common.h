@@ -16,7 +16,10 @@
 #define SUCCESS         1       // a positive value, to indicate success
 #define FAILURE         EOF     // a negative value, to indicate failure
 
+// the host build (SANCUS_HOST) uses the C library's putchar() instead
+#ifndef SANCUS_HOST
 int __attribute__((noinline)) putchar(int c);
+#endif
 
 void __attribute__((noinline)) printf_int(const char* fmt, unsigned int i);
 void __attribute__((noinline)) printf_int_int(const char* fmt, unsigned int i, unsigned int j);
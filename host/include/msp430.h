@@ -0,0 +1,13 @@
+// Host stand-in for the MSP430 register definitions used by the programs
+#ifndef SANCUS_HOST_MSP430_H
+#define SANCUS_HOST_MSP430_H
+
+extern volatile unsigned int WDTCTL;
+
+#define WDTPW                   0x5a00
+#define WDTHOLD                 0x0080
+
+// MSP430 interrupt vectors have no host equivalent
+#define interrupt(vector)       unused
+
+#endif
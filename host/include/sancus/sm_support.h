@@ -0,0 +1,65 @@
+/**
+ * Host stand-in for the Sancus compiler support header (see host/README.md).
+ *
+ * Module text and data are placed in per-module ELF sections, such that the
+ * linker-provided __start_ and __stop_ symbols delimit the protected ranges
+ * of every module. Protection itself is not enforced; module ids, caller ids
+ * and the (toy) wrap primitives are emulated by sancus-host.c.
+ */
+#ifndef SANCUS_HOST_SM_SUPPORT_H
+#define SANCUS_HOST_SM_SUPPORT_H
+
+#include <stddef.h>
+
+#define SANCUS_HOST
+
+#define SANCUS_KEY_SIZE         8
+#define SANCUS_TAG_SIZE         8
+
+// the violation ISR is never triggered on the host
+#define SM_VECTOR               0
+
+typedef unsigned sm_id;
+
+struct SancusModule {
+    sm_id id;
+    unsigned vendor_id;
+    const char *name;
+    void *public_start, *public_end;
+    void *secret_start, *secret_end;
+};
+
+#define SM_FUNC(name)           __attribute__((section("smtext_" name)))
+#define SM_ENTRY(name)          SM_FUNC(name)
+#define SM_DATA(name)           __attribute__((section("smdata_" name)))
+
+// the ranges are weak, as a module need not have any protected data
+#define DECLARE_SM(name, vendor_id) \
+    extern char __start_smtext_##name[] __attribute__((weak)); \
+    extern char __stop_smtext_##name[] __attribute__((weak)); \
+    extern char __start_smdata_##name[] __attribute__((weak)); \
+    extern char __stop_smdata_##name[] __attribute__((weak)); \
+    struct SancusModule name = {0, vendor_id, #name, \
+        __start_smtext_##name, __stop_smtext_##name, \
+        __start_smdata_##name, __stop_smdata_##name}
+
+#define sancus_is_outside_sm(sm, p, len) \
+    sancus_host_is_outside_sm(&(sm), (const void*) (p), (size_t) (len))
+
+sm_id sancus_enable(struct SancusModule *sm);
+sm_id sancus_get_id(void *addr);
+sm_id sancus_get_self_id(void);
+sm_id sancus_get_caller_id(void);
+int sancus_host_is_outside_sm(struct SancusModule *sm, const void *p, size_t len);
+
+int sancus_wrap(const void *ad, size_t ad_len, const void *body, size_t body_len,
+                void *cipher, void *tag);
+int sancus_wrap_with_key(const void *key, const void *ad, size_t ad_len,
+                         const void *body, size_t body_len, void *cipher, void *tag);
+int sancus_unwrap(const void *ad, size_t ad_len, const void *cipher,
+                  size_t cipher_len, const void *tag, void *body);
+int sancus_unwrap_with_key(const void *key, const void *ad, size_t ad_len,
+                           const void *cipher, size_t cipher_len, const void *tag,
+                           void *body);
+
+#endif
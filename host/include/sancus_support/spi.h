@@ -0,0 +1,16 @@
+/**
+ * Host stand-in for the Sancus SPI driver, wired to an in-RAM emulation of the
+ * ST M25P16 serial flash chip (see sancus-host.c)
+ */
+#ifndef SANCUS_HOST_SPI_H
+#define SANCUS_HOST_SPI_H
+
+#include <stdint.h>
+
+void spi_select(void);
+void spi_deselect(void);
+void spi_write_byte(uint8_t b);
+uint8_t spi_read_byte(void);
+void spi_read(uint8_t *buf, unsigned int len);
+
+#endif
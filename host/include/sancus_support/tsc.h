@@ -0,0 +1,35 @@
+/**
+ * Host stand-in for the Sancus time stamp counter (see host/README.md).
+ *
+ * By default a "cycle" is one unit of deterministic work: a basic block executed
+ * by code built with -fsanitize-coverage=trace-pc, or an SPI byte transfer, such
+ * that measurements do not depend on the host machine or its load. Build with
+ * HOST_TSC_CLOCK to count wall clock nanoseconds instead.
+ */
+#ifndef SANCUS_HOST_TSC_H
+#define SANCUS_HOST_TSC_H
+
+#include <stdint.h>
+
+// as on the device, where uint64_t is an unsigned long long (printed with %llu)
+typedef unsigned long long tsc_t;
+
+extern volatile tsc_t host_tsc;
+
+#ifdef HOST_TSC_CLOCK
+    #include <time.h>
+#endif
+
+static inline __attribute__((always_inline, no_instrument_function))
+tsc_t tsc_read(void)
+{
+#ifdef HOST_TSC_CLOCK
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (tsc_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+    return host_tsc;
+#endif
+}
+
+#endif
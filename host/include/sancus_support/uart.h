@@ -0,0 +1,8 @@
+// Host stand-in for the Sancus UART driver: bytes go to stdout unmodified
+#ifndef SANCUS_HOST_UART_H
+#define SANCUS_HOST_UART_H
+
+void uart_init(void);
+void uart_write_byte(unsigned char b);
+
+#endif
@@ -0,0 +1,340 @@
+/**
+ * Host emulation of the Sancus platform pieces used by the SFS programs, such
+ * that they run unchanged (and measurably) as a native process:
+ *
+ *  - module ids: sancus_enable() hands out ids in order; the id of the running
+ *    module is tracked through -finstrument-functions hooks that map every
+ *    function entry onto the module whose text section contains it
+ *  - wrap/unwrap: a toy keystream cipher with a keyed checksum as tag; it is
+ *    NOT secure, but round trips and rejects modified input like the real thing
+ *  - tsc: a deterministic work counter (see sancus_support/tsc.h)
+ *  - uart: stdout
+ *  - spi: an in-RAM ST M25P16 serial flash (2MB, 64KB sectors, 256B pages)
+ *
+ * This file must itself be compiled without -finstrument-functions and
+ * -fsanitize-coverage.
+ */
+#include <sancus/sm_support.h>
+#include <sancus_support/tsc.h>
+#include <sancus_support/uart.h>
+#include <sancus_support/spi.h>
+#include <msp430.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define NO_INSTR                __attribute__((no_instrument_function))
+
+volatile unsigned int WDTCTL;
+volatile tsc_t host_tsc;
+
+// ############################### MODULE IDS #####################################
+
+#define HOST_MAX_MODULES        8
+#define HOST_MAX_CALL_DEPTH     256
+
+struct SancusModule *host_modules[HOST_MAX_MODULES];
+unsigned int host_nb_modules;
+
+// the module of every active instrumented call; 0 for unprotected code
+sm_id host_call_stack[HOST_MAX_CALL_DEPTH];
+int host_call_depth;
+
+#define IN_RANGE(p, start, end) \
+    ((start) && (char*) (p) >= (char*) (start) && (char*) (p) < (char*) (end))
+
+sm_id NO_INSTR sancus_enable(struct SancusModule *sm)
+{
+    if (!sm->id && host_nb_modules < HOST_MAX_MODULES)
+    {
+        host_modules[host_nb_modules++] = sm;
+        sm->id = host_nb_modules;
+    }
+    return sm->id;
+}
+
+sm_id NO_INSTR sancus_get_id(void *addr)
+{
+    unsigned int i;
+    for (i = 0; i < host_nb_modules; i++)
+        if (IN_RANGE(addr, host_modules[i]->public_start, host_modules[i]->public_end))
+            return host_modules[i]->id;
+    return 0;
+}
+
+sm_id NO_INSTR sancus_get_self_id(void)
+{
+    return host_call_depth ? host_call_stack[host_call_depth - 1] : 0;
+}
+
+/*
+ * The caller of the running module is the module of the closest enclosing call
+ * that runs in a different module
+ */
+sm_id NO_INSTR sancus_get_caller_id(void)
+{
+    sm_id self = sancus_get_self_id();
+    int i;
+    for (i = host_call_depth - 2; i >= 0; i--)
+        if (host_call_stack[i] != self)
+            return host_call_stack[i];
+    return 0;
+}
+
+int NO_INSTR sancus_host_is_outside_sm(struct SancusModule *sm, const void *p, size_t len)
+{
+    const char *start = (const char*) sm->secret_start;
+    const char *end = (const char*) sm->secret_end;
+    if ((const char*) p + len < (const char*) p)
+        return 0;
+    return !start || (const char*) p + len <= start || (const char*) p >= end;
+}
+
+void NO_INSTR __cyg_profile_func_enter(void *fn, void *call_site)
+{
+    if (host_call_depth < HOST_MAX_CALL_DEPTH)
+        host_call_stack[host_call_depth] = sancus_get_id(fn);
+    host_call_depth++;
+}
+
+void NO_INSTR __cyg_profile_func_exit(void *fn, void *call_site)
+{
+    host_call_depth--;
+}
+
+// every basic block executed by code built with -fsanitize-coverage=trace-pc
+void NO_INSTR __sanitizer_cov_trace_pc(void)
+{
+    host_tsc++;
+}
+
+// ############################### WRAP / UNWRAP ##################################
+
+uint8_t host_module_key[SANCUS_KEY_SIZE];
+
+// FNV-1a, keyed by processing the key first
+static uint32_t NO_INSTR host_mac_update(uint32_t h, const void *buf, size_t len)
+{
+    const uint8_t *b = (const uint8_t*) buf;
+    while (len--)
+        h = (h ^ *b++) * 16777619u;
+    return h;
+}
+
+static void NO_INSTR host_tag(const void *key, const void *ad, size_t ad_len,
+                              const void *cipher, size_t len, uint8_t *tag)
+{
+    uint32_t h = host_mac_update(2166136261u, key, SANCUS_KEY_SIZE);
+    uint32_t g;
+    int i;
+    h = host_mac_update(h, ad, ad_len);
+    g = host_mac_update(h ^ 0x5a5a5a5a, cipher, len);
+    h = host_mac_update(h, cipher, len);
+    for (i = 0; i < SANCUS_TAG_SIZE; i++)
+        tag[i] = (i < 4 ? h : g) >> (8 * (i % 4));
+}
+
+static void NO_INSTR host_crypt(const void *key, const void *in, size_t len, void *out)
+{
+    const uint8_t *k = (const uint8_t*) key;
+    size_t i;
+    for (i = 0; i < len; i++)
+        ((uint8_t*) out)[i] = ((const uint8_t*) in)[i] ^ k[i % SANCUS_KEY_SIZE] ^ (uint8_t) (i * 151);
+}
+
+int NO_INSTR sancus_wrap_with_key(const void *key, const void *ad, size_t ad_len,
+                                  const void *body, size_t body_len, void *cipher, void *tag)
+{
+    host_crypt(key, body, body_len, cipher);
+    host_tag(key, ad, ad_len, cipher, body_len, tag);
+    return 1;
+}
+
+int NO_INSTR sancus_unwrap_with_key(const void *key, const void *ad, size_t ad_len,
+                                    const void *cipher, size_t cipher_len, const void *tag,
+                                    void *body)
+{
+    uint8_t expected[SANCUS_TAG_SIZE];
+    host_tag(key, ad, ad_len, cipher, cipher_len, expected);
+    if (memcmp(expected, tag, SANCUS_TAG_SIZE))
+        return 0;
+    host_crypt(key, cipher, cipher_len, body);
+    return 1;
+}
+
+int NO_INSTR sancus_wrap(const void *ad, size_t ad_len, const void *body, size_t body_len,
+                         void *cipher, void *tag)
+{
+    return sancus_wrap_with_key(host_module_key, ad, ad_len, body, body_len, cipher, tag);
+}
+
+int NO_INSTR sancus_unwrap(const void *ad, size_t ad_len, const void *cipher,
+                           size_t cipher_len, const void *tag, void *body)
+{
+    return sancus_unwrap_with_key(host_module_key, ad, ad_len, cipher, cipher_len, tag, body);
+}
+
+// ############################### UART ###########################################
+
+void NO_INSTR uart_init(void)
+{
+    setvbuf(stdout, NULL, _IOFBF, 1 << 16);
+}
+
+void NO_INSTR uart_write_byte(unsigned char b)
+{
+    fputc(b, stdout);
+}
+
+// ############################### SPI FLASH ######################################
+
+// ST M25P16 geometry and command set codes (see sfs/cfs/flash_driver.h)
+#define FLASH_SIZE              (2UL * 1024 * 1024)
+#define FLASH_SECTOR_SIZE       65536UL
+#define FLASH_PAGE_SIZE         256UL
+
+#define SPI_FLASH_WREN          0x06
+#define SPI_FLASH_WRDI          0x04
+#define SPI_FLASH_RDID          0x9f
+#define SPI_FLASH_RDSR          0x05
+#define SPI_FLASH_READ          0x03
+#define SPI_FLASH_RDHS          0x0b
+#define SPI_FLASH_PP            0x02
+#define SPI_FLASH_SE            0xd8
+#define SPI_FLASH_BE            0xc7
+
+static const uint8_t flash_id[] = {0x20, 0x20, 0x15};
+
+uint8_t flash_mem[FLASH_SIZE];
+int flash_powered_up;
+
+// the state of the current chip select cycle
+struct {
+    int selected;
+    int write_enabled;
+    uint8_t cmd;
+    unsigned int nb_bytes;      // transferred so far, including the command
+    unsigned long addr;
+} flash;
+
+// the number of command and address (and dummy) bytes before the data bytes
+static unsigned int NO_INSTR flash_header_len(uint8_t cmd)
+{
+    switch (cmd)
+    {
+        case SPI_FLASH_READ:
+        case SPI_FLASH_PP:
+        case SPI_FLASH_SE:
+            return 4;
+        case SPI_FLASH_RDHS:
+            return 5;
+        default:
+            return 1;
+    }
+}
+
+void NO_INSTR spi_select(void)
+{
+    if (!flash_powered_up)
+    {
+        memset(flash_mem, 0xff, FLASH_SIZE);
+        flash_powered_up = 1;
+    }
+    flash.selected = 1;
+    flash.nb_bytes = 0;
+    flash.addr = 0;
+}
+
+// erase and program commands execute when chip select is driven high
+void NO_INSTR spi_deselect(void)
+{
+    if (flash.nb_bytes && flash.write_enabled)
+    {
+        switch (flash.cmd)
+        {
+            case SPI_FLASH_SE:
+                if (flash.nb_bytes >= 4)
+                    memset(flash_mem + (flash.addr & ~(FLASH_SECTOR_SIZE - 1)), 0xff,
+                        FLASH_SECTOR_SIZE);
+                flash.write_enabled = 0;
+                break;
+            case SPI_FLASH_BE:
+                memset(flash_mem, 0xff, FLASH_SIZE);
+                flash.write_enabled = 0;
+                break;
+            case SPI_FLASH_PP:
+                flash.write_enabled = 0;
+                break;
+        }
+    }
+    flash.selected = 0;
+}
+
+// a full duplex transfer of a single byte
+static uint8_t NO_INSTR spi_transfer(uint8_t out)
+{
+    uint8_t in = 0xff;
+    unsigned int header;
+    host_tsc++;
+
+    if (!flash.selected)
+        return in;
+    if (flash.nb_bytes == 0)
+    {
+        flash.cmd = out;
+        if (out == SPI_FLASH_WREN)
+            flash.write_enabled = 1;
+        else if (out == SPI_FLASH_WRDI)
+            flash.write_enabled = 0;
+        flash.nb_bytes++;
+        return in;
+    }
+
+    header = flash_header_len(flash.cmd);
+    if (flash.nb_bytes < 4 && header >= 4)
+        flash.addr = ((flash.addr << 8) | out) & (FLASH_SIZE - 1);
+    else if (flash.nb_bytes >= header)
+    {
+        switch (flash.cmd)
+        {
+            case SPI_FLASH_READ:
+            case SPI_FLASH_RDHS:
+                in = flash_mem[flash.addr];
+                flash.addr = (flash.addr + 1) & (FLASH_SIZE - 1);
+                break;
+            case SPI_FLASH_PP:
+                // programming only clears bits; the address wraps within the page
+                if (flash.write_enabled)
+                    flash_mem[flash.addr] &= out;
+                flash.addr = (flash.addr & ~(FLASH_PAGE_SIZE - 1)) |
+                    ((flash.addr + 1) & (FLASH_PAGE_SIZE - 1));
+                break;
+            case SPI_FLASH_RDSR:
+                // operations complete instantly: WIP is never set
+                in = flash.write_enabled ? 0x02 : 0x00;
+                break;
+            case SPI_FLASH_RDID:
+                if (flash.nb_bytes - 1 < sizeof(flash_id))
+                    in = flash_id[flash.nb_bytes - 1];
+                break;
+        }
+    }
+    flash.nb_bytes++;
+    return in;
+}
+
+void NO_INSTR spi_write_byte(uint8_t b)
+{
+    spi_transfer(b);
+}
+
+uint8_t NO_INSTR spi_read_byte(void)
+{
+    return spi_transfer(0xff);
+}
+
+void NO_INSTR spi_read(uint8_t *buf, unsigned int len)
+{
+    while (len--)
+        *buf++ = spi_transfer(0xff);
+}
@@ -1,6 +1,166 @@
 #include "../../common.h"
+#include "../../benchmark.h"
 #include "../sfs/sfs.h"
 #include "sfs-benchmark.h"
+#ifdef PRINT_FLASH_STATS
+    #include "../sfs/cfs/flash_driver.h"
+#endif
+
+const char *sfs_stat_op_names[SFS_NB_STAT_OPS] = {"sfs_open", "sfs_close",
+    "sfs_getc", "sfs_putc", "sfs_seek", "sfs_pread", "sfs_pwrite", "sfs_chmod",
+    "sfs_remove"};
+const char *sfs_fail_names[SFS_NB_FAIL_CAUSES] = {"bad_fd", "perm", "pool",
+    "no_file", "busy", "backend", "invalid"};
+const char *sfs_pool_names[SFS_NB_POOLS] = {"file_pool", "perm_pool", "fd_cache",
+    "cfs_files", "cfs_fds"};
+#ifdef SFS_PROFILE
+const char *sfs_layer_names[SFS_NB_LAYERS] = {"sfs", "cfs", "meta", "flash"};
+#endif
+
+// unprotected, such that the SFS module can fill it in
+struct sfs_stats the_sfs_stats;
+
+/*
+ * Prints the SFS call and failure counts and pool usage (cur/max/size) since
+ * the previous call, and restarts the statistics. With SFS_PROFILE, also prints
+ * the average inclusive/exclusive cycles per call every op spent in every layer.
+ */
+void dump_sfs_stats(void)
+{
+    int i;
+    sfs_stats(&the_sfs_stats, 1);
+
+    printf("sfs calls:");
+    for (i = 0; i < SFS_NB_STAT_OPS; i++)
+        printf(" %s=%lu", sfs_stat_op_names[i], the_sfs_stats.calls[i]);
+    printf("\nsfs failures:");
+    for (i = 0; i < SFS_NB_FAIL_CAUSES; i++)
+        printf(" %s=%lu", sfs_fail_names[i], the_sfs_stats.failures[i]);
+    printf("\nsfs pools:");
+    for (i = 0; i < SFS_NB_POOLS; i++)
+        printf(" %s=%u/%u/%u", sfs_pool_names[i], the_sfs_stats.pool[i].cur,
+            the_sfs_stats.pool[i].max, the_sfs_stats.pool[i].size);
+    printf("\n");
+
+#ifdef SFS_PROFILE
+    int j;
+    for (i = 0; i < SFS_NB_STAT_OPS; i++)
+    {
+        unsigned long calls = the_sfs_stats.calls[i];
+        if (!calls)
+            continue;
+        printf("sfs stats for %s:", sfs_stat_op_names[i]);
+        for (j = 0; j < SFS_NB_LAYERS; j++)
+            printf(" %s=%lu/%lu", sfs_layer_names[j],
+                the_sfs_stats.layer[i][j].incl / calls,
+                the_sfs_stats.layer[i][j].excl / calls);
+        printf("\n");
+    }
+#endif
+}
+
+#ifdef SFS_TRACE
+#define TRACE_CHUNK     16
+
+// unprotected, such that the SFS module can fill it in
+struct sfs_trace_rec the_sfs_trace[TRACE_CHUNK];
+
+/*
+ * Prints and empties the SFS trace ring, one "sfs trace:" line per call
+ *
+ *      sfs trace: <op> <caller_id> <name> <fd> <arg1> <arg2> <rv>
+ *
+ * with the filename as a number (see struct sfs_trace_rec); to be replayed on
+ * the host with sfs-replay
+ */
+void dump_sfs_trace(void)
+{
+    int i, n;
+    const char *op;
+    while ((n = sfs_trace(the_sfs_trace, TRACE_CHUNK)) > 0)
+    {
+        for (i = 0; i < n; i++)
+        {
+            struct sfs_trace_rec *r = &the_sfs_trace[i];
+            if (r->op < SFS_NB_STAT_OPS)
+                op = sfs_stat_op_names[r->op];
+            else if (r->op == SFS_TRACE_GETC_RUN)
+                op = "getc_run";
+            else if (r->op == SFS_TRACE_PUTC_RUN)
+                op = "putc_run";
+            else
+                op = "lost";
+            printf("sfs trace: %s %u %d %d %d %d %d\n", op, r->caller_id,
+                r->name, r->fd, r->arg1, r->arg2, r->rv);
+        }
+    }
+}
+    #define DUMP_SFS_TRACE()    dump_sfs_trace();
+#else
+    #define DUMP_SFS_TRACE()
+#endif
+
+#ifdef RUN_WCET_BENCHMARK
+const char *wcet_state_names[WCET_NB_STATES] = {"full pools", "full fd_cache",
+    "fragmented arenas", "log merge", "garbage collection"};
+const char *sfs_path_names[SFS_NB_PATHS] = {"flash_scan", "gc", "merge_log",
+    "compact", "move"};
+
+/*
+ * Prints the number and max cycles of the measurements of every label of the
+ * previous WCET run, and the unbounded paths (see sfs-prof.h) they took, and
+ * restarts the bookkeeping
+ *
+ *      wcet for <label>: n=<n> max=<cycles> paths: <path>... | none
+ */
+void dump_wcet_paths(void)
+{
+    int i, j;
+    for (i = 0; i < wcet_nb_labels; i++)
+    {
+        printf("wcet for %s: n=%lu max=%lu paths:", wcet_paths[i].label,
+            wcet_paths[i].nb, (unsigned long) wcet_paths[i].max);
+        if (!wcet_paths[i].paths)
+            printf(" none");
+        for (j = 0; j < SFS_NB_PATHS; j++)
+            if (wcet_paths[i].paths & (1 << j))
+                printf(" %s", sfs_path_names[j]);
+        printf("\n");
+    }
+    wcet_nb_labels = 0;
+}
+#endif
+
+#ifdef PRINT_FLASH_STATS
+const char *sf_stat_cmd_names[SF_NB_STAT_CMDS] = {"read", "pp", "se", "be", "rdid"};
+
+struct sf_stats the_sf_stats;
+
+/*
+ * Prints the flash operations, data bytes and busy wait polls per command and
+ * the erases per sector since the previous call, and restarts the statistics
+ */
+void dump_flash_stats(void)
+{
+    int i;
+    sf_stats_snapshot(&the_sf_stats);
+    sf_stats_reset();
+
+    for (i = 0; i < SF_NB_STAT_CMDS; i++)
+        if (the_sf_stats.cmd[i].ops)
+            printf("flash %s: ops=%lu bytes=%lu polls=%lu\n", sf_stat_cmd_names[i],
+                the_sf_stats.cmd[i].ops, the_sf_stats.cmd[i].bytes,
+                the_sf_stats.cmd[i].polls);
+    printf("flash sector erases:");
+    for (i = 0; i < SF_NB_SECTORS; i++)
+        if (the_sf_stats.sector_erases[i])
+            printf(" %d:%u", i, the_sf_stats.sector_erases[i]);
+    printf("\n");
+}
+    #define DUMP_FLASH_STATS()  dump_flash_stats();
+#else
+    #define DUMP_FLASH_STATS()
+#endif
 
 int main()
 {
@@ -13,17 +173,69 @@ int main()
     sancus_enable(&sfsBenchmarkSm);
     sancus_enable(&sfsBenchmarkHelperSm);
     
+    tsc_calibrate();
+
+    // sweep the file sizes and number of files at runtime, rather than rebuilding
+    // for every value
 #ifdef RUN_FILES_BENCHMARK    
-    run_files_benchmark();
+    int nb_files, file_size;
+    for (file_size = INIT_BENCHMARK_FILE_SIZE; file_size <= MAX_BENCHMARK_FILE_SIZE;
+         file_size *= BENCHMARK_FILE_SIZE_STEP)
+    {
+        for (nb_files = 1; nb_files <= NB_BENCHMARK_FILES; nb_files++)
+        {
+            printf_int_int("\n[main] files benchmark: %d file(s) of %d bytes\n", nb_files,
+                file_size);
+            run_files_benchmark(nb_files, file_size);
+            tsc_dump();
+            dump_sfs_stats();
+            DUMP_FLASH_STATS()
+            DUMP_SFS_TRACE()
+        }
+    }
 #endif
 
 #ifdef RUN_ACL_BENCHMARK
-    run_acl_benchmark();
+    int acl_length;
+    for (acl_length = 1; acl_length <= MAX_ACL_BENCHMARK_LENGTH; acl_length++)
+    {
+        printf_int("\n[main] acl benchmark: acl length %d\n", acl_length);
+        run_acl_benchmark(acl_length);
+        tsc_dump();
+        dump_sfs_stats();
+        DUMP_FLASH_STATS()
+        DUMP_SFS_TRACE()
+    }
+#endif
+
+#ifdef RUN_WCET_BENCHMARK
+    int state;
+    for (state = 0; state < WCET_NB_STATES; state++)
+    {
+        printf("\n[main] wcet benchmark: %s\n", wcet_state_names[state]);
+        run_wcet_benchmark(state);
+        tsc_dump();
+        dump_wcet_paths();
+        dump_sfs_stats();
+        DUMP_FLASH_STATS()
+        DUMP_SFS_TRACE()
+    }
+#endif
+
+#ifdef RUN_FLASH_BENCHMARK
+    run_flash_benchmark();
+    dump_sfs_stats();
+    DUMP_FLASH_STATS()
+    DUMP_SFS_TRACE()
 #endif
 
     sfs_ping();
+    tsc_dump();
     
     puts("[main] exiting\n-----------------");
+#ifdef SANCUS_HOST
+    return 0;
+#endif
     while (1) {}
 }
 
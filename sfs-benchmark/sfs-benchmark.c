@@ -1,31 +1,63 @@
 #include "../../common.h"
 #include "../../benchmark.h"
 #include "../sfs/sfs.h"
+#include "sfs-benchmark.h"
 
 /********** BENCHMARK PARAMETERS **********/
 
-#ifndef NB_BENCHMARK_FILES
-    #define NB_BENCHMARK_FILES            1
+#ifndef BATCH_RUN_LENGTH
+    #define BATCH_RUN_LENGTH              8
 #endif
 
-#ifndef MAX_ACL_BENCHMARK_LENGTH
-    #define MAX_ACL_BENCHMARK_LENGTH      1
+#ifndef SEALED_BENCHMARK_LENGTH
+    #define SEALED_BENCHMARK_LENGTH       32    // at most SFS_SEALED_MAX_LEN
 #endif
 
-#ifndef INIT_BENCHMARK_FILE_SIZE
-    #define INIT_BENCHMARK_FILE_SIZE      10
+#ifndef FLASH_BENCHMARK_SIZE
+    #define FLASH_BENCHMARK_SIZE          256   // at most one flash page
 #endif
 
-#ifndef MAX_ACL_BENCHMARK_LENGTH
-    #define MAX_ACL_BENCHMARK_LENGTH      1
+// the number of measurements of an operation in a WCET state
+#ifndef WCET_NB_REPS
+    #define WCET_NB_REPS                  8
 #endif
 
+// the number of create/remove rounds in the Coffee GC state; Coffee ignores the
+// size hint and reserves COFFEE_DYN_SIZE (17 pages) per file, so this fills the
+// 8192 pages of the 2MB flash with obsolete files
+#ifndef WCET_GC_ROUNDS
+    #define WCET_GC_ROUNDS                512
+#endif
+
+// the number of overwrites and appends of a file in the Coffee log state
+#ifndef WCET_LOG_WRITES
+    #define WCET_LOG_WRITES               64
+#endif
+#ifndef WCET_APPEND_LENGTH
+    #define WCET_APPEND_LENGTH            256
+#endif
+
+// the file size of the other WCET states; that of the fragmented state fits
+// five times in the default 1000 byte my_malloc arena
+#define WCET_FILE_SIZE                100
+#define WCET_FRAG_FILE_SIZE           150
+#define WCET_RUN_LENGTH               8
+
+// the front-end perm pool (10) minus the creator entries of MAX_BENCHMARK_FILES
+#define WCET_ACL_LENGTH               5
+// the front-end fd_cache size
+#define WCET_NB_FDS                   8
+
 #define filename_start      'f'
 //#define DO_DUMP
 
 /********** UTILITY MACROS **********/
 
-#define EXIT            while (1) {}
+#ifdef SANCUS_HOST
+    #define EXIT        exit(EXIT_FAILURE);
+#else
+    #define EXIT        while (1) {}
+#endif
 #define ASSERT(cond) \
 do { \
     if(!(cond)) \
@@ -56,29 +88,127 @@ DECLARE_SM(sfsBenchmarkHelperSm, 0x1234);
 
 #ifdef RUN_FILES_BENCHMARK
 
+// unprotected batch submission area for sfs_batch()
+struct sfs_op batch_ops[2];
+unsigned char batch_buf[BATCH_RUN_LENGTH];
+
+// unprotected staging area for sealed bulk transfers
+unsigned char sealed_cipher[SEALED_BENCHMARK_LENGTH];
+unsigned char client_tag[SANCUS_TAG_SIZE];
+
+// session key (in protected memory) and plain text buffers of the client SM
+unsigned char SM_DATA("sfsBenchmarkSm") client_key[SANCUS_KEY_SIZE];
+unsigned char SM_DATA("sfsBenchmarkSm") sealed_plain[SEALED_BENCHMARK_LENGTH];
+unsigned char SM_DATA("sfsBenchmarkSm") sealed_check[SEALED_BENCHMARK_LENGTH];
+
+/**
+ * sealed bulk read of SEALED_BENCHMARK_LENGTH bytes (including the unwrap in
+ * the client SM) vs an sfs_getc loop of the same length; then checks that the
+ * sealed data matches the file, that a sealed write of the same bytes reads
+ * back, and that a partial key, a tampered tag or a replayed transfer is refused
+ */
+void SM_FUNC("sfsBenchmarkSm") run_sealed_benchmark(int fd, sm_id my_id)
+{
+    int j, n, session = 0;
+    for (j = 0; j < SANCUS_KEY_SIZE; j++)
+        client_key[j] = 0x42 + j;
+    for (j = 0; j < SANCUS_KEY_SIZE / 2; j++)
+    {
+#ifndef DUMMY_BACKEND
+        // no sealed transfers under a partially set key
+        ASSERT(sfs_read_sealed(fd, sealed_cipher, 1, client_tag) < 0);
+#endif
+        session = sfs_set_key(fd, j, client_key[2*j] | (client_key[2*j+1] << 8));
+    }
+
+    TSC_BENCH("sfs_getc loop", sfs_seek(fd, 0, SFS_SEEK_SET),
+        for (j = 0; j < SEALED_BENCHMARK_LENGTH; j++) sealed_plain[j] = sfs_getc(fd), );
+
+    // the last key word returns the session number; the sequence number starts
+    // at zero and is bumped by every sealed transfer
+    struct sfs_sealed_ad ad;
+    unsigned int seq = 0;
+    int ok __attribute__((unused)) = 0;     // unchecked on the dummy back-ends
+    ad.caller_id = my_id;
+    ad.fd = fd;
+    ad.session = session;
+    TSC_BENCH("sfs_read_sealed + sancus_unwrap", sfs_seek(fd, 0, SFS_SEEK_SET),
+        n = sfs_read_sealed(fd, sealed_cipher, SEALED_BENCHMARK_LENGTH, client_tag);
+        ad.seq = seq;
+        ad.len = n;
+        if (n > 0)
+            ok = sancus_unwrap_with_key(client_key, &ad, sizeof(ad), sealed_cipher,
+                n, client_tag, sealed_check),
+        if (n >= 0) seq++);
+
+#ifndef DUMMY_BACKEND
+    ASSERT(session > 0 && n > 0 && ok);
+    for (j = 0; j < n; j++)
+        ASSERT(sealed_check[j] == sealed_plain[j]);
+
+    // write the same bytes back sealed, such that the file is unchanged
+    ad.seq = seq;
+    ad.len = n;
+    ASSERT(sancus_wrap_with_key(client_key, &ad, sizeof(ad), sealed_plain, n,
+        sealed_cipher, client_tag));
+    sfs_seek(fd, 0, SFS_SEEK_SET);
+    ASSERT(sfs_write_sealed(fd, sealed_cipher, n, client_tag) == n);
+    seq++;
+
+    // a replay of the same transfer, and one with a tampered tag, are refused
+    sfs_seek(fd, 0, SFS_SEEK_SET);
+    ASSERT(sfs_write_sealed(fd, sealed_cipher, n, client_tag) < 0);
+    ad.seq = seq;
+    ASSERT(sancus_wrap_with_key(client_key, &ad, sizeof(ad), sealed_plain, n,
+        sealed_cipher, client_tag));
+    client_tag[0] ^= 0x01;
+    ASSERT(sfs_write_sealed(fd, sealed_cipher, n, client_tag) < 0);
+
+    sfs_seek(fd, 0, SFS_SEEK_SET);
+    ASSERT(sfs_read_sealed(fd, sealed_cipher, n, client_tag) == n);
+    ASSERT(sancus_unwrap_with_key(client_key, &ad, sizeof(ad), sealed_cipher, n,
+        client_tag, sealed_check));
+    for (j = 0; j < n; j++)
+        ASSERT(sealed_check[j] == sealed_plain[j]);
+
+    // setting the same key again starts a new session, under which a transfer
+    // sealed for the old one (and its sequence number 0) is refused
+    for (j = 0; j < SANCUS_KEY_SIZE / 2; j++)
+        n = sfs_set_key(fd, j, client_key[2*j] | (client_key[2*j+1] << 8));
+    ASSERT(n > session);
+    ad.seq = 0;
+    ad.len = SEALED_BENCHMARK_LENGTH;
+    ASSERT(sancus_wrap_with_key(client_key, &ad, sizeof(ad), sealed_plain,
+        SEALED_BENCHMARK_LENGTH, sealed_cipher, client_tag));
+    sfs_seek(fd, 0, SFS_SEEK_SET);
+    ASSERT(sfs_write_sealed(fd, sealed_cipher, SEALED_BENCHMARK_LENGTH, client_tag) < 0);
+#endif
+}
+
 void SM_ENTRY("sfsBenchmarkHelperSm") ping_helper(void)
 {
     return;
 }
 
 /**
- * NB_BENCHMARK_FILES files, 1 acl entry
+ * nb_files files of file_size bytes, 1 acl entry; all but the first-time
+ * operations are repeated with TSC_BENCH() to measure a distribution
  */
-void SM_ENTRY("sfsBenchmarkSm") run_files_benchmark(void)
+void SM_ENTRY("sfsBenchmarkSm") run_files_benchmark(int nb_files, int file_size)
 {
     sm_id my_id = sancus_get_self_id();
     printdebug_int(A "Hi from benchmark SM, I have id %d\n", my_id);
     ASSERT(my_id == A_ID);
     ping_helper();
     ASSERT(B_ID == sancus_get_id(sfsBenchmarkHelperSm.public_start));
+    if (nb_files > MAX_BENCHMARK_FILES)
+        nb_files = MAX_BENCHMARK_FILES;
 
     PRINT_SEC("PING")
     TSC1()
     sfs_ping();
     TSC2("sfs_ping_1st")
-    TSC1()
-    sfs_ping();
-    TSC2("sfs_ping_2nd")
+    TSC_BENCH("sfs_ping", , sfs_ping(), );
     
     PRINT_SEC("INIT")
     TSC1()
@@ -91,13 +221,13 @@ void SM_ENTRY("sfsBenchmarkSm") run_files_benchmark(void)
     TSC2("sfs_init_2nd")
 
     PRINT_SEC("OPEN 1st")
-    int fds[NB_BENCHMARK_FILES];
+    int fds[MAX_BENCHMARK_FILES];
     int i;
-    for (i = 0; i < NB_BENCHMARK_FILES; i++)
+    for (i = 0; i < nb_files; i++)
     {
         char name = filename_start + i;
         TSC1()
-        fds[i] = sfs_open(name, SFS_CREATOR, INIT_BENCHMARK_FILE_SIZE);
+        fds[i] = sfs_open(name, SFS_CREATOR, file_size);
         TSC2("sfs_open_1st")
         sfs_close(fds[i]);
     }
@@ -105,85 +235,122 @@ void SM_ENTRY("sfsBenchmarkSm") run_files_benchmark(void)
     
     // open in the same order, to get worse case measurements
     PRINT_SEC("OPEN 2nd")
-    for (i = 0; i < NB_BENCHMARK_FILES; i++)
+    for (i = 0; i < nb_files; i++)
     {
         char name = filename_start + i;
-        TSC1()
+        TSC_BENCH("sfs_open_2nd", , fds[i] = sfs_open(name, SFS_ROOT, SFS_OPEN_EXISTING),
+            sfs_close(fds[i]));
         fds[i] = sfs_open(name, SFS_ROOT, SFS_OPEN_EXISTING);
-        TSC2("sfs_open_2nd")
     }
 
     PRINT_SEC("SEEK")
-    for (i = 0; i < NB_BENCHMARK_FILES; i++)
+    for (i = 0; i < nb_files; i++)
     { 
         int fd = fds[i];
-        TSC1()
-        sfs_seek(fd, 0, SFS_SEEK_SET);
-        TSC2("sfs_seek")
+        TSC_BENCH("sfs_seek", , sfs_seek(fd, 0, SFS_SEEK_SET), );
     }
     
+    // rewind before every run, so repetitions never hit EOF
     PRINT_SEC("GETC")
-    for (i = 0; i < NB_BENCHMARK_FILES; i++)
+    for (i = 0; i < nb_files; i++)
     { 
         int fd = fds[i];
-        TSC1()
-        sfs_getc(fd);
-        TSC2("sfs_getc")
+        TSC_BENCH("sfs_getc", sfs_seek(fd, 0, SFS_SEEK_SET), sfs_getc(fd), );
     }
     
     PRINT_SEC("PUTC")
-    for (i = 0; i < NB_BENCHMARK_FILES; i++)
+    for (i = 0; i < nb_files; i++)
     { 
         int fd = fds[i];
-        TSC1()
-        sfs_putc(fd, 'a');
-        TSC2("sfs_putc")
+        TSC_BENCH("sfs_putc", sfs_seek(fd, 0, SFS_SEEK_SET), sfs_putc(fd, 'a'), );
     }
 
     DUMP
 
+    PRINT_SEC("PREAD")
+    for (i = 0; i < nb_files; i++)
+    { 
+        int fd = fds[i];
+        TSC_BENCH("sfs_pread", , sfs_pread(fd, 0), );
+    }
+    
+    PRINT_SEC("PWRITE")
+    for (i = 0; i < nb_files; i++)
+    { 
+        int fd = fds[i];
+        TSC_BENCH("sfs_pwrite", , sfs_pwrite(fd, 0, 'a'), );
+    }
+
+    PRINT_SEC("GETC LOOP vs SEALED READ")
+    for (i = 0; i < nb_files; i++)
+        run_sealed_benchmark(fds[i], my_id);
+
+    PRINT_SEC("PUTC LOOP vs BATCH")
+    for (i = 0; i < nb_files; i++)
+    {
+        int fd = fds[i], j;
+        TSC_BENCH("sfs_seek + sfs_putc loop", ,
+            sfs_seek(fd, 0, SFS_SEEK_SET);
+            for (j = 0; j < BATCH_RUN_LENGTH; j++) sfs_putc(fd, 'a'), );
+        
+        for (j = 0; j < BATCH_RUN_LENGTH; j++)
+            batch_buf[j] = 'b';
+        batch_ops[0].op = SFS_OP_SEEK;
+        batch_ops[0].fd = fd;
+        batch_ops[0].arg1 = 0;
+        batch_ops[0].arg2 = SFS_SEEK_SET;
+        batch_ops[1].op = SFS_OP_PUTC_RUN;
+        batch_ops[1].fd = fd;
+        batch_ops[1].arg1 = BATCH_RUN_LENGTH;
+        batch_ops[1].buf = batch_buf;
+        TSC_BENCH("sfs_batch (seek + putc run)", , sfs_batch(batch_ops, 2), );
+#ifndef DUMMY_BACKEND
+        ASSERT(batch_ops[1].rv == BATCH_RUN_LENGTH);
+#endif
+    }
+
+    // every repetition adds the acl entry anew, by revoking it afterwards
     PRINT_SEC("ADD_ACL")
-    for (i = 0; i < NB_BENCHMARK_FILES; i++)
+    for (i = 0; i < nb_files; i++)
     {
         char name = filename_start + i;
-        TSC1()
+        TSC_BENCH("sfs_chmod (add_acl)", , sfs_chmod(name, B_ID, SFS_READ),
+            sfs_chmod(name, B_ID, SFS_NIL));
         sfs_chmod(name, B_ID, SFS_READ);
-        TSC2("sfs_chmod (add_acl)")
     }
     DUMP
     
     // revoke_acl is worst case, since B has no open file descriptors
     PRINT_SEC("REVOKE_ACL")
-    for (i = 0; i < NB_BENCHMARK_FILES; i++)
+    for (i = 0; i < nb_files; i++)
     {
         char name = filename_start + i;
-        TSC1()
-        sfs_chmod(name, B_ID, SFS_NIL);
-        TSC2("sfs_chmod (revoke_acl)")
+        TSC_BENCH("sfs_chmod (revoke_acl)", sfs_chmod(name, B_ID, SFS_READ),
+            sfs_chmod(name, B_ID, SFS_NIL), );
     }
     DUMP
 
     PRINT_SEC("ATTEST")
-    for (i = 0; i < NB_BENCHMARK_FILES; i++)
+    for (i = 0; i < nb_files; i++)
     {
         char name = filename_start + i;
-        TSC1()
-        sfs_attest(name, sfsBenchmarkSm.id);
-        TSC2("sfs_attest")
+        TSC_BENCH("sfs_attest", , sfs_attest(name, sfsBenchmarkSm.id), );
     }
 
+    // every repetition closes a freshly opened fd
     PRINT_SEC("CLOSE")
-    for (i = 0; i < NB_BENCHMARK_FILES; i++)
+    for (i = 0; i < nb_files; i++)
     {
+        char name = filename_start + i;
         int fd = fds[i];
-        TSC1()
+        TSC_BENCH("sfs_close", , sfs_close(fd),
+            fd = sfs_open(name, SFS_ROOT, SFS_OPEN_EXISTING));
         sfs_close(fd);
-        TSC2("sfs_close")
     }
 
     //acl_size =  1 (because permissions are revoked)
     PRINT_SEC("REMOVE")
-    for (i = 0; i < NB_BENCHMARK_FILES; i++)
+    for (i = 0; i < nb_files; i++)
     {
         char name = filename_start + i;
         TSC1()
@@ -244,9 +411,9 @@ void SM_FUNC("sfsBenchmarkSm") construct_acl_for_b(char filename, int length)
 }
 
 /**
- * 1 file; up to MAX_ACL_BENCHMARK_LENGTH ACL measurements
+ * 1 file; ACL measurements for an ACL of acl_length entries
  */
-void SM_ENTRY("sfsBenchmarkSm") run_acl_benchmark(void)
+void SM_ENTRY("sfsBenchmarkSm") run_acl_benchmark(int acl_length)
 {
     sm_id my_id = sancus_get_self_id();
     printdebug_int(A "Hi from benchmark SM, I have id %d\n", my_id);
@@ -255,15 +422,360 @@ void SM_ENTRY("sfsBenchmarkSm") run_acl_benchmark(void)
     
     PRINT_SEC("GROWING ACL")
 
+    int fd = sfs_open(filename_start, SFS_CREATOR, 10);
+    sfs_close(fd);
+    construct_acl_for_b(filename_start, acl_length);
+    // SM b will remove the file
+    PRINT_SEP
+}
+
+#endif // RUN_ACL_BENCHMARK
+
+#ifdef RUN_WCET_BENCHMARK
+
+#include "../sfs/sfs-prof.h"
+
+#ifndef SFS_WCET
+    #error "the WCET benchmark needs an SFS_WCET build to flag the unbounded paths"
+#endif
+
+struct wcet_paths wcet_paths[WCET_MAX_LABELS];
+int wcet_nb_labels;
+
+// unprotected batch submission area for sfs_batch()
+struct sfs_op wcet_op;
+unsigned char wcet_buf[WCET_RUN_LENGTH];
+
+/*
+ * An unprotected function, such that both benchmark SMs can record the paths
+ * and cycles (the_diff) of their measurements; every label is a string literal
+ * used at one site
+ */
+void __attribute__((noinline)) wcet_record(const char *label, unsigned int paths)
+{
+    uint32_t cycles = (the_diff > UINT32_MAX) ? UINT32_MAX : (uint32_t) the_diff;
     int i;
-    for (i = 1; i <= MAX_ACL_BENCHMARK_LENGTH; i++)
+    for (i = 0; i < wcet_nb_labels; i++)
+        if (wcet_paths[i].label == label)
+            break;
+    if (i == wcet_nb_labels)
+    {
+        if (i == WCET_MAX_LABELS)
+            return;
+        wcet_paths[i].label = label;
+        wcet_paths[i].paths = 0;
+        wcet_paths[i].nb = 0;
+        wcet_paths[i].max = 0;
+        wcet_nb_labels++;
+    }
+    wcet_paths[i].paths |= paths;
+    wcet_paths[i].nb++;
+    if (cycles > wcet_paths[i].max)
+        wcet_paths[i].max = cycles;
+}
+
+/*
+ * Measures @p(stmt) and records the unbounded paths it took; the max of a label
+ * in wcet_paths is the observed WCET of its operation and state, while the
+ * percentiles of tsc_dump() only cover the last TSC_RING_SIZE samples
+ */
+#define WCET(str, stmt) \
+do { \
+    sfs_wcet_paths = 0; \
+    TSC1() \
+    stmt; \
+    TSC2(str) \
+    wcet_record(str, sfs_wcet_paths); \
+} while(0)
+
+/**
+ * Every operation of B on the file at the end of the file list, with B at the
+ * end of its ACL
+ */
+void SM_ENTRY("sfsBenchmarkHelperSm") wcet_full_acl_b(char name)
+{
+    int fd, rep;
+    for (rep = 0; rep < WCET_NB_REPS; rep++)
     {
-        int fd = sfs_open(filename_start, SFS_CREATOR, 10);
+        WCET("wcet sfs_open (full acl)",
+            fd = sfs_open(name, SFS_ROOT, SFS_OPEN_EXISTING));
+        WCET("wcet sfs_putc (full acl)", sfs_putc(fd, 'a'));
+        WCET("wcet sfs_seek (full acl)", sfs_seek(fd, 0, SFS_SEEK_SET));
+        WCET("wcet sfs_getc (full acl)", sfs_getc(fd));
+        WCET("wcet sfs_pwrite (full acl)", sfs_pwrite(fd, 0, 'a'));
+        WCET("wcet sfs_pread (full acl)", sfs_pread(fd, 0));
+
+        wcet_op.op = SFS_OP_GETC_RUN;
+        wcet_op.fd = fd;
+        wcet_op.arg1 = WCET_RUN_LENGTH;
+        wcet_op.buf = wcet_buf;
+        sfs_seek(fd, 0, SFS_SEEK_SET);
+        WCET("wcet sfs_batch getc run (full acl)", sfs_batch(&wcet_op, 1));
+
+        // B overrides its own entry: CHECK_ROOT and add_acl walk the entire ACL
+        WCET("wcet sfs_chmod (full acl)", sfs_chmod(name, B_ID, SFS_ROOT));
+        WCET("wcet sfs_attest (full acl)", sfs_attest(name, B_ID));
+        WCET("wcet sfs_close (full acl)", sfs_close(fd));
+    }
+}
+
+void SM_ENTRY("sfsBenchmarkHelperSm") wcet_remove_b(char name)
+{
+    WCET("wcet sfs_remove (full acl)", sfs_remove(name));
+}
+
+/**
+ * Opens the file until the fd_cache (or the back-end) runs out of fds
+ */
+void SM_ENTRY("sfsBenchmarkHelperSm") wcet_fill_fd_cache_b(char name)
+{
+    int i;
+    for (i = 0; i < WCET_NB_FDS && sfs_open(name, SFS_READ, SFS_OPEN_EXISTING) >= 0; i++)
+        ;
+}
+
+void SM_FUNC("sfsBenchmarkSm") wcet_create_files(int nb_files, int file_size)
+{
+    int i;
+    for (i = 0; i < nb_files; i++)
+        sfs_close(sfs_open(filename_start + i, SFS_CREATOR, file_size));
+}
+
+// removes every file of the WCET states that still exists
+void SM_FUNC("sfsBenchmarkSm") wcet_remove_files(void)
+{
+    int i;
+    for (i = 0; i <= MAX_BENCHMARK_FILES; i++)
+        sfs_remove(filename_start + i);
+}
+
+/**
+ * Fills the file pool and, with the ACL of the first file, the perm pool; files
+ * are added in front of the file list, so B gets the last entry of the ACL of
+ * the last file, with root access
+ */
+void SM_FUNC("sfsBenchmarkSm") wcet_fill_pools(void)
+{
+    int i;
+    wcet_create_files(MAX_BENCHMARK_FILES, WCET_FILE_SIZE);
+    for (i = WCET_ACL_LENGTH; i > 1; i--)
+        sfs_chmod(filename_start, B_ID + i, SFS_READ);
+    sfs_chmod(filename_start, B_ID, SFS_ROOT);
+}
+
+void SM_FUNC("sfsBenchmarkSm") wcet_pools(void)
+{
+    char last = filename_start + MAX_BENCHMARK_FILES - 1;
+    int rep, fd;
+
+    wcet_fill_pools();
+    wcet_full_acl_b(filename_start);
+
+    // creating the last file takes the last free structs; then none are left
+    for (rep = 0; rep < WCET_NB_REPS; rep++)
+    {
+        sfs_remove(last);
+        WCET("wcet sfs_open create (full pools)",
+            fd = sfs_open(last, SFS_CREATOR, WCET_FILE_SIZE));
         sfs_close(fd);
-        construct_acl_for_b(filename_start, i);
-        // SM b will remove the file
-        PRINT_SEP
+        WCET("wcet sfs_open create fails (full pools)",
+            sfs_open(last + 1, SFS_CREATOR, WCET_FILE_SIZE));
+    }
+    wcet_remove_files();
+
+    // every repetition removes a file with a full ACL anew
+    for (rep = 0; rep < WCET_NB_REPS; rep++)
+    {
+        wcet_fill_pools();
+        wcet_remove_b(filename_start);
+        wcet_remove_files();
     }
 }
 
-#endif // RUN_ACL_BENCHMARK
+/**
+ * B fills the fd_cache with the file; revoking its permission closes them all
+ */
+void SM_FUNC("sfsBenchmarkSm") wcet_fd_cache(void)
+{
+    int rep, fd, fd2;
+    fd = sfs_open(filename_start, SFS_CREATOR, WCET_FILE_SIZE);
+    for (rep = 0; rep < WCET_NB_REPS; rep++)
+    {
+        sfs_chmod(filename_start, B_ID, SFS_READ);
+        wcet_fill_fd_cache_b(filename_start);
+        WCET("wcet sfs_open (full fd_cache)",
+            fd2 = sfs_open(filename_start, SFS_ROOT, SFS_OPEN_EXISTING));
+        if (fd2 >= 0)
+            sfs_close(fd2);
+        WCET("wcet sfs_chmod revoke (full fd_cache)",
+            sfs_chmod(filename_start, B_ID, SFS_NIL));
+    }
+    sfs_close(fd);
+    sfs_remove(filename_start);
+}
+
+/**
+ * Removing every other file fragments the my_malloc arenas, such that a larger
+ * file only fits after compaction; growing a file then moves it
+ */
+void SM_FUNC("sfsBenchmarkSm") wcet_fragmented(void)
+{
+    char big = filename_start + MAX_BENCHMARK_FILES;
+    char last = filename_start + MAX_BENCHMARK_FILES - 1;
+    int rep, i, fd;
+    for (rep = 0; rep < WCET_NB_REPS; rep++)
+    {
+        wcet_create_files(MAX_BENCHMARK_FILES, WCET_FRAG_FILE_SIZE);
+        for (i = 1; i < MAX_BENCHMARK_FILES; i += 2)
+            sfs_remove(filename_start + i);
+
+        WCET("wcet sfs_open create (fragmented)",
+            fd = sfs_open(big, SFS_CREATOR, 2 * WCET_FRAG_FILE_SIZE));
+        sfs_close(fd);
+
+        fd = sfs_open(last, SFS_ROOT, SFS_OPEN_EXISTING);
+        sfs_seek(fd, WCET_FRAG_FILE_SIZE, SFS_SEEK_SET);
+        for (i = 0; i < 2 * WCET_RUN_LENGTH; i++)
+            WCET("wcet sfs_putc grow (fragmented)", sfs_putc(fd, 'a'));
+        sfs_close(fd);
+        wcet_remove_files();
+    }
+}
+
+/**
+ * Overwrites fill Coffee's micro log until it is merged with the file; appends
+ * beyond the reserved size extend the file (shm: grow it)
+ */
+void SM_FUNC("sfsBenchmarkSm") wcet_log(void)
+{
+    int i, fd;
+    fd = sfs_open(filename_start, SFS_CREATOR, WCET_FILE_SIZE);
+    for (i = 0; i < WCET_FILE_SIZE; i++)
+        sfs_putc(fd, 'a');
+
+    for (i = 0; i < WCET_LOG_WRITES; i++)
+        WCET("wcet sfs_pwrite overwrite (log)",
+            sfs_pwrite(fd, i % WCET_FILE_SIZE, 'b'));
+    for (i = 0; i < WCET_NB_REPS; i++)
+        WCET("wcet sfs_pread (log)", sfs_pread(fd, i));
+    for (i = 0; i < WCET_APPEND_LENGTH; i++)
+        WCET("wcet sfs_putc append (log)", sfs_putc(fd, 'c'));
+
+    sfs_close(fd);
+    sfs_remove(filename_start);
+}
+
+/**
+ * Coffee only reclaims the pages of removed files by garbage collection: a
+ * series of files fills the flash, until reserve() collects garbage; only the
+ * first removals are measured, such that the sample ring keeps the creates
+ */
+void SM_FUNC("sfsBenchmarkSm") wcet_gc(void)
+{
+    int rep, fd;
+    for (rep = 0; rep < WCET_GC_ROUNDS; rep++)
+    {
+        WCET("wcet sfs_open create (gc)",
+            fd = sfs_open(filename_start, SFS_CREATOR, WCET_FILE_SIZE));
+        if (fd >= 0)
+            sfs_close(fd);
+        if (rep < WCET_NB_REPS)
+            WCET("wcet sfs_remove (gc)", sfs_remove(filename_start));
+        else
+            sfs_remove(filename_start);
+    }
+}
+
+/**
+ * Drives the SFS entries through the adversarial WCET_* @p(state); every
+ * measurement is summarized in wcet_paths, with the max cycles per operation
+ * and state and the unbounded paths they took
+ */
+void SM_ENTRY("sfsBenchmarkSm") run_wcet_benchmark(int state)
+{
+    sm_id my_id = sancus_get_self_id();
+    printdebug_int(A "Hi from benchmark SM, I have id %d\n", my_id);
+    ASSERT(my_id == A_ID);
+    ASSERT(B_ID == sancus_get_id(sfsBenchmarkHelperSm.public_start));
+    sfs_init();
+
+    switch (state)
+    {
+        case WCET_POOLS:
+            PRINT_SEC("WCET FULL POOLS AND ACL")
+            wcet_pools();
+            break;
+        case WCET_FD_CACHE:
+            PRINT_SEC("WCET FULL FD_CACHE")
+            wcet_fd_cache();
+            break;
+        case WCET_FRAGMENTED:
+            PRINT_SEC("WCET FRAGMENTED ARENAS")
+            wcet_fragmented();
+            break;
+        case WCET_LOG:
+            PRINT_SEC("WCET LOG MERGE")
+            wcet_log();
+            break;
+        case WCET_GC:
+            PRINT_SEC("WCET GARBAGE COLLECTION")
+            wcet_gc();
+            break;
+    }
+    DUMP
+}
+
+#endif // RUN_WCET_BENCHMARK
+
+#ifdef RUN_FLASH_BENCHMARK
+
+#include "../sfs/cfs/flash_driver.h"
+#include "../sfs/cfs/cfs-coffee-arch.h"
+
+// the sector Coffee reserves at the end of the flash chip; erased before use
+#define FLASH_BENCHMARK_ADDR          (COFFEE_START + COFFEE_SIZE)
+
+#if COFFEE_RESERVED_SIZE < COFFEE_SECTOR_SIZE
+    #error "the flash benchmark needs a sector outside Coffee's area (COFFEE_CONF_RESERVED_SIZE)"
+#endif
+
+char SM_DATA("sfsBenchmarkSm") flash_buf[FLASH_BENCHMARK_SIZE];
+
+#define PRINT_CYCLES_PER_BYTE(size) \
+    printf_int("\t=> %u cycles per byte\n", (unsigned int) (the_diff / (size)));
+
+/**
+ * raw flash driver throughput for a single page: measures the SPI transfer
+ * loops of sf_program_page() and sf_read() in isolation of Coffee
+ */
+void SM_ENTRY("sfsBenchmarkSm") run_flash_benchmark(void)
+{
+    int i;
+    for (i = 0; i < FLASH_BENCHMARK_SIZE; i++)
+        flash_buf[i] = i;
+
+    PRINT_SEC("SECTOR ERASE")
+    TSC1()
+    sf_sector_erase(FLASH_BENCHMARK_ADDR);
+    TSC2("sf_sector_erase")
+
+    PRINT_SEC("PROGRAM PAGE")
+    TSC1()
+    sf_program_page(FLASH_BENCHMARK_ADDR, flash_buf, FLASH_BENCHMARK_SIZE);
+    TSC2("sf_program_page")
+    PRINT_CYCLES_PER_BYTE(FLASH_BENCHMARK_SIZE)
+    BLOCK_WAITING();
+
+    PRINT_SEC("READ")
+    for (i = 0; i < FLASH_BENCHMARK_SIZE; i++)
+        flash_buf[i] = 0;
+    TSC1()
+    sf_read(FLASH_BENCHMARK_ADDR, flash_buf, FLASH_BENCHMARK_SIZE);
+    TSC2("sf_read")
+    PRINT_CYCLES_PER_BYTE(FLASH_BENCHMARK_SIZE)
+
+    for (i = 0; i < FLASH_BENCHMARK_SIZE; i++)
+        ASSERT(flash_buf[i] == (char) i);
+}
+
+#endif // RUN_FLASH_BENCHMARK
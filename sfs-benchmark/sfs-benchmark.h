@@ -1,14 +1,78 @@
 #ifndef SFS_BENCHMARK_H
+#define SFS_BENCHMARK_H
+
+// NB_BENCHMARK_FILES, MAX_ACL_BENCHMARK_LENGTH and INIT_BENCHMARK_FILE_SIZE are
+// the defaults for the runtime arguments of the benchmark entry points (see main);
+// main sweeps every file count and ACL length up to the given maximum and every
+// file size from INIT_BENCHMARK_FILE_SIZE up to MAX_BENCHMARK_FILE_SIZE
+
+// the runtime number of files is bounded by the front-end file pool
+#define MAX_BENCHMARK_FILES               5
+
+#ifndef NB_BENCHMARK_FILES
+    #define NB_BENCHMARK_FILES            1
+#endif
+
+#ifndef MAX_ACL_BENCHMARK_LENGTH
+    #define MAX_ACL_BENCHMARK_LENGTH      1
+#endif
+
+#ifndef INIT_BENCHMARK_FILE_SIZE
+    #define INIT_BENCHMARK_FILE_SIZE      10
+#endif
+
+#ifndef MAX_BENCHMARK_FILE_SIZE
+    #define MAX_BENCHMARK_FILE_SIZE       INIT_BENCHMARK_FILE_SIZE
+#endif
+
+// the factor between subsequent file sizes of the sweep
+#ifndef BENCHMARK_FILE_SIZE_STEP
+    #define BENCHMARK_FILE_SIZE_STEP      10
+#endif
 
 extern struct SancusModule sfsBenchmarkSm;
 extern struct SancusModule sfsBenchmarkHelperSm;
 
 #ifdef RUN_FILES_BENCHMARK
-    void SM_ENTRY("sfsBenchmarkSm") run_files_benchmark(void);
+    void SM_ENTRY("sfsBenchmarkSm") run_files_benchmark(int nb_files, int file_size);
 #endif
 
 #ifdef RUN_ACL_BENCHMARK
-    void SM_ENTRY("sfsBenchmarkSm") run_acl_benchmark(void);
+    void SM_ENTRY("sfsBenchmarkSm") run_acl_benchmark(int acl_length);
+#endif
+
+#ifdef RUN_FLASH_BENCHMARK
+    void SM_ENTRY("sfsBenchmarkSm") run_flash_benchmark(void);
+#endif
+
+#ifdef RUN_WCET_BENCHMARK
+    // the adversarial states of the WCET benchmark, one run each
+    #define WCET_POOLS                    0     // full file and perm pools and ACL
+    #define WCET_FD_CACHE                 1     // full fd_cache
+    #define WCET_FRAGMENTED               2     // fragmented my_malloc arenas
+    #define WCET_LOG                      3     // Coffee log merges, file growth
+    #define WCET_GC                       4     // Coffee garbage collection
+    #define WCET_NB_STATES                5
+
+    // the number of distinct labels a run of the WCET benchmark measures
+    #define WCET_MAX_LABELS               16
+
+    /*
+     * The unbounded paths (SFS_PATH_* bits) the measurements of a label took in
+     * any of its runs, and their number and max cycles, such that the max does
+     * not depend on the samples the ring still holds; unprotected, such that
+     * main can report them
+     */
+    struct wcet_paths {
+        const char *label;
+        unsigned int paths;
+        unsigned long nb;
+        uint32_t max;
+    };
+    extern struct wcet_paths wcet_paths[WCET_MAX_LABELS];
+    extern int wcet_nb_labels;
+
+    void SM_ENTRY("sfsBenchmarkSm") run_wcet_benchmark(int state);
 #endif
 
 #endif
@@ -23,63 +23,127 @@
 
 // #################### MALLOC DATASTRUCTURES ########################
 
-#define INIT_BUF_SIZE   1000    // device has 10 KB (10240B) data memory
-// request a protected buf for malloc
-char buf[INIT_BUF_SIZE];
+// request a buf for malloc
+char malloc_buf[MALLOC_NB_ARENAS][MALLOC_BUF_SIZE] __attribute__((aligned(MALLOC_ALIGN)));
 
-// linked list of free chunks to be allocated
-// Note the overhead per free_chunk: save new free_chunk and keep old free_chunk
+/*
+ * Every chunk, free or allocated, is enclosed by a header and a footer tag
+ * (boundary tags) that both hold the chunk's payload size. Sizes are multiples
+ * of MALLOC_ALIGN (and thus even), so the LSB marks an allocated chunk. The footer of the preceding chunk and the
+ * header of the following chunk allow my_free() to coalesce in constant time.
+ *
+ *  | size|a | payload (size bytes) ... | size|a |
+ *
+ * Every arena starts with an allocated footer and ends with an allocated header
+ * tag, such that coalescing never looks past the arena boundaries. All arenas
+ * share a single free list.
+ */
+#define TAG_SIZE            sizeof(size_t)
+#define ALLOC_BIT           0x1
+#define TAG_CHUNK_SIZE(tag) ((tag) & ~((size_t) ALLOC_BIT))
+#define HDR(ptr)            ((size_t*) ((char*) (ptr) - TAG_SIZE))
+#define PAYLOAD(hdr)        ((void*) ((char*) (hdr) + TAG_SIZE))
+#define FTR(hdr)            ((size_t*) ((char*) (hdr) + TAG_SIZE + TAG_CHUNK_SIZE(*(hdr))))
+#define NEXT_HDR(hdr)       ((size_t*) ((char*) FTR(hdr) + TAG_SIZE))
+#define PREV_FTR(hdr)       ((size_t*) ((char*) (hdr) - TAG_SIZE))
+#define PREV_HDR(hdr)       ((size_t*) ((char*) PREV_FTR(hdr) - TAG_SIZE - \
+                                TAG_CHUNK_SIZE(*PREV_FTR(hdr))))
+#define SET_TAGS(hdr, size, alloc) \
+do { \
+    *(hdr) = (size) | (alloc); \
+    *FTR(hdr) = (size) | (alloc); \
+} while(0)
+
+// doubly linked list of free chunks to be allocated; the links are stored in
+// the (otherwise unused) payload of a free chunk
 struct FREE_CHUNK {
-    size_t size;
+    size_t size;                // header tag
     struct FREE_CHUNK *next;
-    // max allocatable free space = &(free_chunk->next)+1 until &(free_chunk->next) + size
+    struct FREE_CHUNK *prev;
 };
+#define ALIGN_UP(n)         (((n) + MALLOC_ALIGN - 1) & ~((size_t) MALLOC_ALIGN - 1))
+#define MIN_PAYLOAD         ALIGN_UP(sizeof(struct FREE_CHUNK) - TAG_SIZE)
+#define MALLOC_INIT_DONE    (*((size_t*) malloc_buf[0]) == ALLOC_BIT)
+
 struct FREE_CHUNK *free_list_head;
 
+#define UNLINK(c) \
+do { \
+    if ((c)->prev) (c)->prev->next = (c)->next; \
+    else free_list_head = (c)->next; \
+    if ((c)->next) (c)->next->prev = (c)->prev; \
+} while(0)
+
+#define PUSH(c) \
+do { \
+    (c)->prev = NULL; \
+    (c)->next = free_list_head; \
+    if (free_list_head) free_list_head->prev = (c); \
+    free_list_head = (c); \
+} while(0)
+
+
+// keep the tags and payloads aligned and leave room for the free list links;
+// as the arenas are aligned and two tags span a multiple of MALLOC_ALIGN, every
+// payload then is MALLOC_ALIGN aligned
+#define ROUND_PAYLOAD(size) \
+    (ALIGN_UP(size) < MIN_PAYLOAD ? MIN_PAYLOAD : ALIGN_UP(size))
+
+// marks the chunk at hdr, with avail payload bytes, allocated for size bytes;
+// the remainder is split off as a new free chunk, iff it can hold one
+#define PLACE(hdr, avail, size) \
+do { \
+    size_t place_avail = (avail); \
+    if (place_avail >= (size) + 2*TAG_SIZE + MIN_PAYLOAD) { \
+        SET_TAGS(hdr, size, ALLOC_BIT); \
+        size_t *rest = NEXT_HDR(hdr); \
+        SET_TAGS(rest, place_avail - (size) - 2*TAG_SIZE, 0); \
+        PUSH((struct FREE_CHUNK*) rest); \
+    } else { \
+        SET_TAGS(hdr, place_avail, ALLOC_BIT); \
+    } \
+} while(0)
+
+
+// copies n bytes word by word; payloads are word aligned and of even size
+#define COPY_PAYLOAD(dst, src, n) \
+do { \
+    size_t *to = (size_t*) (dst), *from = (size_t*) (src), left = (n); \
+    for (; left >= sizeof(size_t); left -= sizeof(size_t)) \
+        *to++ = *from++; \
+    char *to_c = (char*) to, *from_c = (char*) from; \
+    while (left--) \
+        *to_c++ = *from_c++; \
+} while(0)
 
 // ###########################  MALLOC IMPLEMENTATION ##########################
 
 /*
- * Returns a pointer in the protected char array, to a free chunk of the requested size;
+ * Returns a pointer in the char array, to a free chunk of the requested size;
  *  or NULL iff no free chunk of sufficient size found
  */
 void *my_malloc(size_t size) {
-    //printdebug(MALL "hi from my_malloc!");
+    if (!MALLOC_INIT_DONE) init_free_list();
+
+    size = ROUND_PAYLOAD(size);
 
-    if (!free_list_head) init_free_list();
     // walk through the list of free_chunks until one is found that is large enough to 
     // hold the request (i.e. "first-fit")
-    struct FREE_CHUNK *prev = free_list_head;
     struct FREE_CHUNK *cur = free_list_head;
-    while (cur != NULL && cur->size < size) {
-        prev = cur;
+    while (cur != NULL && cur->size < size)
         cur = cur->next;
-    }
     if (!cur) {
         printerr(MALL "the end of the free list was reached; " \
             "no free_chunk of sufficient size found. Returning null...");
         return NULL;
     }
-    
-    // allocate the memory and create a new free_chunk for the remainder, if any
-    // note: save the old free_chunk and the allocated size just above the returned pointer
-    void *ret = (void*) cur + sizeof(struct FREE_CHUNK) + 1;
-    int remainder = cur->size - size - sizeof(struct FREE_CHUNK);
-    
-    if (remainder > 0) {
-        // create a new free_chunk for the remainder
-        cur->size = size;
-        struct FREE_CHUNK *new = (void*) cur + sizeof(struct FREE_CHUNK) + size + 1;
-        new->size = remainder;
-        new->next = cur->next;
-        prev->next = new;
-    } else {
-        printdebug_int(MALL "no remainder in the allocated free_chunk 0x%x\n", cur);
-        // allocate all to the result
-        prev->next = cur->next;
-    }
-    printdebug_int_int(MALL "returning address 0x%x with size %d\n", ret, size);
-    return (void*) ret;
+    UNLINK(cur);
+
+    size_t *hdr = (size_t*) cur;
+    PLACE(hdr, cur->size, size);
+
+    printdebug_int_int(MALL "returning address 0x%x with size %d\n", PAYLOAD(hdr), size);
+    return PAYLOAD(hdr);
 }
 
 /*
@@ -87,13 +151,18 @@ void *my_malloc(size_t size) {
  *  since the HW will overwrite any initialisation before a call to sancus_enable.
  */
 void init_free_list(void) {
-    free_list_head = (struct FREE_CHUNK*) buf;
-    free_list_head->size = 0; // to keep the free_list_head pointer static
-    
-    struct FREE_CHUNK *new = (struct FREE_CHUNK*) (buf + sizeof(struct FREE_CHUNK));
-    free_list_head->next = new;
-    new->size = INIT_BUF_SIZE - sizeof(struct FREE_CHUNK)*2;
-    new->next = NULL; //XXX cirkular? optimal?
+    int a;
+    free_list_head = NULL;
+    for (a = MALLOC_NB_ARENAS - 1; a >= 0; a--) {
+        // prologue footer and epilogue header, marked allocated
+        *((size_t*) malloc_buf[a]) = ALLOC_BIT;
+        *((size_t*) (malloc_buf[a] + MALLOC_BUF_SIZE - TAG_SIZE)) = ALLOC_BIT;
+
+        size_t *hdr = (size_t*) (malloc_buf[a] + TAG_SIZE);
+        SET_TAGS(hdr, MALLOC_BUF_SIZE - 4*TAG_SIZE, 0);
+        PUSH((struct FREE_CHUNK*) hdr);
+    }
+
     printdebug(MALL "the init free list is:");
     print_free_list();
 }
@@ -103,45 +172,144 @@ void init_free_list(void) {
  *  pointer obtained by a call to my_malloc(), the behaviour is unspecified.
  */
 void my_free(void *ptr) {
-    if (!ptr || ptr < (void*) &buf || ptr > (void*) &buf+INIT_BUF_SIZE-1) {
+    if (!ptr || (char*) ptr < malloc_buf[0] + 2*TAG_SIZE ||
+        (char*) ptr > malloc_buf[MALLOC_NB_ARENAS-1] + MALLOC_BUF_SIZE - 1) {
         printerr(FREE "the given pointer is outside the buf boundaries. Returning...");
         return;
     }
-    
-    // re-access the old free_chunk, saved at allocation time
-    struct FREE_CHUNK *new  = (struct FREE_CHUNK*) (ptr - sizeof(struct FREE_CHUNK) - 1);
-    printdebug_int(FREE "the size to free is: %d\n", new->size);
-    
-    // search the (sorted) free list to insert the free block
-    struct FREE_CHUNK *cur = free_list_head;
-    while (cur != NULL && !(ptr > (void*) cur && (cur->next == NULL || ptr < (void*) cur->next)))
-        cur = cur->next;
-    if (!cur) {
-        printerr(FREE "insertion failed; no free chunk found");
+
+    size_t *hdr = HDR(ptr);
+    if (!(*hdr & ALLOC_BIT)) {
+        printerr(FREE "the given pointer is not allocated. Returning...");
         return;
     }
-    
-    // check if merging is possible
-    // TODO TODO check if merged chunk can again be merged...
-    if (ptr+new->size == (void*) cur->next) {
-        printdebug_int(FREE "merging before 0x%x\n", cur->next);
-        new->next = cur->next->next;
-        new->size += sizeof(struct FREE_CHUNK) + cur->next->size;
-        cur->next = new;
-    }
-    else if (cur != free_list_head && (void*) cur + sizeof(struct FREE_CHUNK)*2 + cur->size == ptr) {
-        // don't merge with the (static) head free_chunk
-        printdebug_int(FREE "merging after 0x%x\n", cur);
-        cur->size += sizeof(struct FREE_CHUNK) + new->size;
+    size_t size = TAG_CHUNK_SIZE(*hdr);
+    printdebug_int(FREE "the size to free is: %d\n", size);
+
+    // coalesce with the following chunk, iff free
+    size_t *next = NEXT_HDR(hdr);
+    if (!(*next & ALLOC_BIT)) {
+        printdebug_int(FREE "merging before 0x%x\n", next);
+        UNLINK((struct FREE_CHUNK*) next);
+        size += 2*TAG_SIZE + *next;
     }
-    else {
-        printdebug_int(FREE "inserting new free_chunk after 0x%x\n", cur);
-        new->next = cur->next;
-        cur->next = new;
+
+    // coalesce with the preceding chunk, iff free
+    if (!(*PREV_FTR(hdr) & ALLOC_BIT)) {
+        hdr = PREV_HDR(hdr);
+        printdebug_int(FREE "merging after 0x%x\n", hdr);
+        UNLINK((struct FREE_CHUNK*) hdr);
+        size += 2*TAG_SIZE + *hdr;
     }
+
+    SET_TAGS(hdr, size, 0);
+    PUSH((struct FREE_CHUNK*) hdr);
     //print_free_list();
 }
 
+/*
+ * Resizes the allocation at @param(ptr) to at least @param(size) bytes. A chunk
+ *  is grown in place when the following chunk is free and large enough; else the
+ *  data is moved to a new chunk. Returns the (possibly moved) pointer, or NULL
+ *  iff no space was found, in which case the original chunk is left untouched.
+ */
+void *my_realloc(void *ptr, size_t size) {
+    if (!ptr) return my_malloc(size);
+
+    size_t *hdr = HDR(ptr);
+    size_t cur_size = TAG_CHUNK_SIZE(*hdr);
+    size = ROUND_PAYLOAD(size);
+    if (size <= cur_size)
+        return ptr;
+
+    // grow in place into the following chunk, iff free and large enough
+    size_t *next = NEXT_HDR(hdr);
+    size_t avail = cur_size + 2*TAG_SIZE + *next;
+    if (!(*next & ALLOC_BIT) && avail >= size) {
+        printdebug_int(MALL "growing in place into 0x%x\n", next);
+        UNLINK((struct FREE_CHUNK*) next);
+        PLACE(hdr, avail, size);
+        return ptr;
+    }
+
+    // move-on-grow
+    void *new_ptr = my_malloc(size);
+    if (!new_ptr)
+        return NULL;
+    COPY_PAYLOAD(new_ptr, ptr, cur_size);
+    my_free(ptr);
+
+    printdebug_int(MALL "moved on grow to 0x%x\n", new_ptr);
+    return new_ptr;
+}
+
+/*
+ * Returns the number of usable bytes in the allocation at @param(ptr).
+ */
+size_t my_malloc_size(void *ptr) {
+    return TAG_CHUNK_SIZE(*HDR(ptr));
+}
+
+/*
+ * Slides all allocated chunks down to the start of their arena, such that the
+ *  free space of every arena ends up in a single chunk at its end. @param(relocate) is called for
+ *  every moved chunk with its old and new payload pointers, such that the owner
+ *  can update its references. Returns the number of moved chunks.
+ */
+unsigned int my_compact(malloc_relocate_t relocate) {
+    if (!MALLOC_INIT_DONE) init_free_list();
+
+    unsigned int moved = 0;
+    int a;
+    free_list_head = NULL;
+    for (a = MALLOC_NB_ARENAS - 1; a >= 0; a--) {
+        // the epilogue header is the only allocated tag with a zero size
+        size_t *hdr = (size_t*) (malloc_buf[a] + TAG_SIZE), *dst = hdr;
+        while (TAG_CHUNK_SIZE(*hdr)) {
+            size_t *next = NEXT_HDR(hdr);
+            if (*hdr & ALLOC_BIT) {
+                size_t size = TAG_CHUNK_SIZE(*hdr);
+                if (dst != hdr) {
+                    // dst < hdr, so a forward copy never overwrites unread data
+                    COPY_PAYLOAD(PAYLOAD(dst), PAYLOAD(hdr), size);
+                    SET_TAGS(dst, size, ALLOC_BIT);
+                    relocate(PAYLOAD(hdr), PAYLOAD(dst));
+                    moved++;
+                }
+                dst = NEXT_HDR(dst);
+            }
+            hdr = next;
+        }
+
+        // the gap consists of former free chunks, so it can always hold one
+        if (dst != hdr) {
+            SET_TAGS(dst, (char*) hdr - (char*) dst - 2*TAG_SIZE, 0);
+            PUSH((struct FREE_CHUNK*) dst);
+        }
+    }
+
+    printdebug_int(MALL "compaction moved %d chunks\n", moved);
+    return moved;
+}
+
+/*
+ * Fills in @param(stats) with the current free space, the largest free chunk
+ *  and the number of free chunks.
+ */
+void my_malloc_stats(struct malloc_stats *stats) {
+    if (!MALLOC_INIT_DONE) init_free_list();
+
+    stats->free_bytes = stats->largest_free = 0;
+    stats->nb_free_chunks = 0;
+    struct FREE_CHUNK *cur;
+    for (cur = free_list_head; cur != NULL; cur = cur->next) {
+        stats->free_bytes += cur->size;
+        if (cur->size > stats->largest_free)
+            stats->largest_free = cur->size;
+        stats->nb_free_chunks++;
+    }
+}
+
 /*
  * Prints the current linked list of free chunks on stdout, iff DEBUG. Used for debugging.
  */
@@ -155,3 +323,121 @@ void print_free_list(void) {
     }
     printdebug("\t\t------------------------------");
 }
+
+// ##################### SEGREGATED-FIT IMPLEMENTATION #########################
+
+/*
+ * An alternative allocator with power-of-two size classes and one free list
+ * per class. Blocks are carved from a bump pointer and never split nor merged,
+ * such that allocation and freeing take constant time (at most SEG_NB_CLASSES
+ * steps), at the cost of internal fragmentation.
+ */
+
+#define SEG_BUF_SIZE        MALLOC_SEG_BUF_SIZE
+#define SEG_MIN_CLASS_SHIFT 3   // the smallest class holds 8 bytes (incl header)
+#define SEG_NB_CLASSES      7   // classes of 8, 16, 32, ..., 512 bytes
+#define SEG_CLASS_SIZE(c)   ((size_t) 1 << ((c) + SEG_MIN_CLASS_SHIFT))
+
+char seg_buf[SEG_BUF_SIZE] __attribute__((aligned(MALLOC_ALIGN)));
+
+// the class index is kept in front of an allocated block; the next pointer
+// is only valid while the block is on a free list (it overlaps the user data)
+struct SEG_CHUNK {
+    size_t class;
+    struct SEG_CHUNK *next;
+};
+// padded, such that the blocks are MALLOC_ALIGN aligned as well
+#define SEG_HDR_SIZE        (sizeof(size_t) > MALLOC_ALIGN ? sizeof(size_t) : MALLOC_ALIGN)
+
+struct SEG_CHUNK *seg_free_lists[SEG_NB_CLASSES];
+char *seg_brk;
+
+/*
+ * Initialises the (empty) size class free lists and the bump pointer.
+ */
+void init_seg_lists(void) {
+    int c;
+    for (c = 0; c < SEG_NB_CLASSES; c++)
+        seg_free_lists[c] = NULL;
+    seg_brk = seg_buf;
+}
+
+/*
+ * Returns a pointer to a block of at least the requested size, taken from the
+ *  free list of the smallest fitting size class; or NULL iff none available
+ */
+void *seg_malloc(size_t size) {
+    if (!seg_brk) init_seg_lists();
+
+    int c;
+    for (c = 0; c < SEG_NB_CLASSES && SEG_CLASS_SIZE(c) < size + SEG_HDR_SIZE; c++)
+        ;
+    if (c == SEG_NB_CLASSES) {
+        printerr(MALL "requested size exceeds the largest size class. Returning null...");
+        return NULL;
+    }
+
+    struct SEG_CHUNK *chunk = seg_free_lists[c];
+    if (chunk) {
+        seg_free_lists[c] = chunk->next;
+    } else {
+        if (seg_brk + SEG_CLASS_SIZE(c) > seg_buf + SEG_BUF_SIZE) {
+            printerr(MALL "no free block in size class and buf exhausted. Returning null...");
+            return NULL;
+        }
+        chunk = (struct SEG_CHUNK*) seg_brk;
+        seg_brk += SEG_CLASS_SIZE(c);
+    }
+    chunk->class = c;
+
+    printdebug_int_int(MALL "seg: returning address 0x%x from class %d\n",
+        (char*) chunk + SEG_HDR_SIZE, c);
+    return (char*) chunk + SEG_HDR_SIZE;
+}
+
+/*
+ * Returns the block pointed to by @param(ptr), obtained by seg_malloc(), to the
+ *  free list of its size class.
+ */
+void seg_free(void *ptr) {
+    if (!ptr || (char*) ptr < seg_buf + SEG_HDR_SIZE || (char*) ptr >= seg_brk) {
+        printerr(FREE "the given pointer is outside the seg_buf boundaries. Returning...");
+        return;
+    }
+
+    struct SEG_CHUNK *chunk = (struct SEG_CHUNK*) ((char*) ptr - SEG_HDR_SIZE);
+    if (chunk->class >= SEG_NB_CLASSES) {
+        printerr(FREE "corrupted size class. Returning...");
+        return;
+    }
+    chunk->next = seg_free_lists[chunk->class];
+    seg_free_lists[chunk->class] = chunk;
+}
+
+/*
+ * Resizes the block at @param(ptr), obtained by seg_malloc(), to at least
+ *  @param(size) bytes. Blocks never grow beyond their size class, so a larger
+ *  request always moves the data. Returns NULL iff no block is available.
+ */
+void *seg_realloc(void *ptr, size_t size) {
+    if (!ptr) return seg_malloc(size);
+
+    size_t cur_size = seg_malloc_size(ptr);
+    if (size <= cur_size)
+        return ptr;
+
+    void *new_ptr = seg_malloc(size);
+    if (!new_ptr)
+        return NULL;
+    COPY_PAYLOAD(new_ptr, ptr, cur_size);
+    seg_free(ptr);
+    return new_ptr;
+}
+
+/*
+ * Returns the number of usable bytes in the block at @param(ptr).
+ */
+size_t seg_malloc_size(void *ptr) {
+    struct SEG_CHUNK *chunk = (struct SEG_CHUNK*) ((char*) ptr - SEG_HDR_SIZE);
+    return SEG_CLASS_SIZE(chunk->class) - SEG_HDR_SIZE;
+}
@@ -24,6 +24,132 @@ DECLARE_SM(clientA, 0x1234);
 #define printa(str)     printdebug(A str)
 #define A_ID            1
 
+/********** CHURN BENCHMARK **********/
+
+#define CHURN_SLOTS         8
+#define CHURN_ROUNDS        64
+
+// the requested sizes cycle through this table; slots are reused round robin
+int churn_sizes[] = { 10, 50, 24, 100, 6, 70, 33, 16, 90, 3 };
+#define NB_CHURN_SIZES      (sizeof(churn_sizes) / sizeof(churn_sizes[0]))
+
+#define RUN_CHURN(malloc_fct, free_fct, failures) \
+do { \
+    char *slots[CHURN_SLOTS] = { NULL }; \
+    int r; \
+    failures = 0; \
+    for (r = 0; r < CHURN_ROUNDS; r++) \
+    { \
+        int s = r % CHURN_SLOTS; \
+        if (slots[s]) \
+            free_fct(slots[s]); \
+        slots[s] = malloc_fct(churn_sizes[r % NB_CHURN_SIZES]); \
+        if (!slots[s]) \
+            failures++; \
+    } \
+    for (r = 0; r < CHURN_SLOTS; r++) \
+        if (slots[r]) \
+            free_fct(slots[r]); \
+} while(0)
+
+/*
+ * compares the first-fit and segregated-fit allocators for an identical
+ * sequence of CHURN_ROUNDS interleaved allocations and frees
+ */
+void SM_ENTRY("clientA") run_churn_benchmark(void)
+{
+    int failures;
+
+    PRINT_SEC("CHURN FIRST-FIT")
+    init_free_list();
+    TSC1()
+    RUN_CHURN(my_malloc, my_free, failures);
+    TSC2("first_fit_churn")
+    printf_int(A "%d failed allocations\n", failures);
+    struct malloc_stats stats;
+    my_malloc_stats(&stats);
+    printf_int_int(A "%d free chunks; fragmentation %d%%\n", stats.nb_free_chunks,
+        MALLOC_FRAGMENTATION(stats));
+
+    PRINT_SEC("CHURN SEGREGATED-FIT")
+    init_seg_lists();
+    TSC1()
+    RUN_CHURN(seg_malloc, seg_free, failures);
+    TSC2("segregated_fit_churn")
+    printf_int(A "%d failed allocations\n", failures);
+}
+
+/********** COMPACTION BENCHMARK **********/
+
+// the live blocks of the compaction benchmark; updated on relocation
+char *compact_slots[CHURN_SLOTS];
+
+void compact_relocate(void *old_ptr, void *new_ptr)
+{
+    int s;
+    for (s = 0; s < CHURN_SLOTS; s++)
+        if (compact_slots[s] == old_ptr)
+            compact_slots[s] = new_ptr;
+}
+
+#define PRINT_FRAGMENTATION(stats) \
+    my_malloc_stats(&stats); \
+    printf_int_int(A "%d free chunks; fragmentation %d%%\n", stats.nb_free_chunks, \
+        MALLOC_FRAGMENTATION(stats));
+
+/*
+ * fragments the first-fit buffer by freeing every other block and measures
+ * the compaction pass that slides the remaining blocks together
+ */
+void SM_ENTRY("clientA") run_compact_benchmark(void)
+{
+    struct malloc_stats stats;
+    int s;
+
+    PRINT_SEC("COMPACTION")
+    init_free_list();
+    for (s = 0; s < CHURN_SLOTS; s++)
+        compact_slots[s] = my_malloc(churn_sizes[s % NB_CHURN_SIZES]);
+    for (s = 0; s < CHURN_SLOTS; s += 2)
+    {
+        my_free(compact_slots[s]);
+        compact_slots[s] = NULL;
+    }
+    PRINT_FRAGMENTATION(stats)
+
+    TSC1()
+    unsigned int moved = my_compact(compact_relocate);
+    TSC2("my_compact")
+    printf_int(A "compaction moved %d blocks\n", moved);
+    PRINT_FRAGMENTATION(stats)
+
+    for (s = 0; s < CHURN_SLOTS; s++)
+        if (compact_slots[s])
+            my_free(compact_slots[s]);
+}
+
+/********** ARENA FILL BENCHMARK **********/
+
+/*
+ * allocates blocks, cycling through the churn sizes, until the first-fit
+ * arenas are exhausted; build with different -DMALLOC_BUF_SIZE values (see
+ * the arena-sweep make target) to relate arena size, success and latency
+ */
+void SM_ENTRY("clientA") run_arena_benchmark(void)
+{
+    int nb_allocs = 0;
+
+    PRINT_SEC("ARENA FILL")
+    printf_int_int(A "%d arena(s) of %d bytes\n", MALLOC_NB_ARENAS, MALLOC_BUF_SIZE);
+    init_free_list();
+    TSC1()
+    while (my_malloc(churn_sizes[nb_allocs % NB_CHURN_SIZES]))
+        nb_allocs++;
+    TSC2("arena_fill")
+    printf_int(A "%d successful allocations\n", nb_allocs);
+    init_free_list();
+}
+
 void SM_ENTRY("clientA") run_malloc_benchmark(void)
 {
     printf_int_int("Hi from A, I was called by %d and I have id %d\n",
@@ -86,6 +212,10 @@ int main()
     sancus_enable(&clientA);
     
     run_malloc_benchmark();
+    run_churn_benchmark();
+    run_compact_benchmark();
+    run_arena_benchmark();
+    tsc_dump();
     
     puts("\n[main] exiting\n-----------------");
     EXIT
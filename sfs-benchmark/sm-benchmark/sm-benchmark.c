@@ -26,7 +26,7 @@ void run_tsc_benchmark(void)
 {
     PRINT_SEC("tsc_read() overhead verification");
     
-    printf("TSC_READ_OVERHEAD is defined as %d\n", TSC_READ_OVERHEAD);
+    tsc_calibrate();
     
     // manually inline tsc_read()
     TSC_CTL = 1;
@@ -35,15 +35,15 @@ void run_tsc_benchmark(void)
     the_ts2 = TSC_VAL;
     the_diff = the_ts2 - the_ts1;
     print_tsc_diff("ts1 = TSC_VAL [manually inlined]");
-    if (the_diff != TSC_READ_OVERHEAD)
-        puts("WARNING: TSC_READ_OVERHEAD seems not to be correctly defined");
+    if (the_diff != tsc_read_overhead)
+        puts("WARNING: tsc_read_overhead seems not to be correctly calibrated");
     
     // verify tsc_read fct is inlined
     the_ts1 = tsc_read();
     the_ts2 = tsc_read();
     the_diff = the_ts2 - the_ts1;
     print_tsc_diff("tsc_read() [should be inlined]");
-    if (the_diff != TSC_READ_OVERHEAD)
+    if (the_diff != tsc_read_overhead)
         puts("WARNING: tsc_read() seems not to be inlined");
     
     // verify provided macros cancel overhead
@@ -170,6 +170,7 @@ int main()
     
     run_tsc_benchmark();
     run_fct_call_benchmark();
+    tsc_dump();
     
     puts("\n[main] exiting\n-----------------");
     EXIT
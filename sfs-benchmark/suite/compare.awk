@@ -0,0 +1,70 @@
+# Compares the results of a benchmark suite run against a baseline (both CSV as
+# produced by tsc2csv.awk). A measurement regresses when its metric exceeds the
+# baseline by more than tolerance percent plus slack cycles; the slack keeps
+# measurements of only a few cycles from failing on a single extra branch.
+# Exits non-zero on any regression; new and missing measurements only warn.
+#
+# usage: awk -F, -v metric=p50 -v tolerance=5 -v slack=2 -f compare.awk \
+#            baseline.csv results.csv
+
+function key()
+{
+    return $1 "," $2 "," $3 "," $4 "," $5 "," $6
+}
+
+FNR == 1 {
+    col = 0
+    for (i = 1; i <= NF; i++)
+        if ($i == metric)
+            col = i
+    if (!col)
+    {
+        print "compare: no column '" metric "' in " FILENAME > "/dev/stderr"
+        failed = 1
+        exit 2
+    }
+    next
+}
+
+NR == FNR {
+    base[key()] = $col
+    next
+}
+
+{
+    k = key()
+    seen[k] = 1
+    if (!(k in base))
+    {
+        print "NEW         " k ": " metric "=" $col
+        nb_new++
+        next
+    }
+    nb_compared++
+    b = base[k] + 0
+    v = $col + 0
+    if (v > b * (1 + tolerance / 100) + slack)
+    {
+        printf "REGRESSION  %s: %s %d -> %d (%+.1f%%)\n", k, metric, b, v, b ? 100 * (v - b) / b : 100
+        nb_regressions++
+    }
+    else if (v < b * (1 - tolerance / 100) - slack)
+    {
+        printf "IMPROVED    %s: %s %d -> %d (%+.1f%%)\n", k, metric, b, v, b ? 100 * (v - b) / b : -100
+        nb_improved++
+    }
+}
+
+END {
+    if (failed)
+        exit 2
+    for (k in base)
+        if (!(k in seen))
+        {
+            print "MISSING     " k
+            nb_missing++
+        }
+    printf "%d measurements compared (%s, tolerance %d%% + %d): %d regressed, %d improved, %d new, %d missing\n",
+        nb_compared, metric, tolerance, slack, nb_regressions, nb_improved, nb_new, nb_missing
+    exit nb_regressions ? 1 : 0
+}
@@ -0,0 +1,61 @@
+# Converts the text log of a benchmark run into CSV rows, one per tsc_dump()
+# statistics line (see benchmark.c) and one per flash operation counter (see
+# main.c), keyed by the run announced by main.c:
+#
+#   backend,benchmark,nb_files,file_size,acl_length,label,n,min,p50,p90,p99,max
+#
+# usage: awk -v backend=SHM -f tsc2csv.awk benchmark.log
+
+{ sub(/\r$/, "") }
+
+# [main] files benchmark: <nb> file(s) of <size> bytes
+/^\[main\] files benchmark:/ {
+    run = "files," $4 "," $7 ","
+    dumped = 0
+    next
+}
+
+# [main] acl benchmark: acl length <length> (a single file of 10 bytes)
+/^\[main\] acl benchmark:/ {
+    run = "acl,1,10," $NF
+    dumped = 0
+    next
+}
+
+# every run is followed by exactly one dump; later samples have no run
+/tsc samples recorded/ {
+    if (dumped)
+        run = ""
+    dumped = 1
+    next
+}
+
+/^cycles for .*: n=/ && run != "" {
+    label = $0
+    sub(/^cycles for /, "", label)
+    sub(/: n=[0-9].*$/, "", label)
+    gsub(/"/, "\"\"", label)
+
+    stats = $0
+    sub(/^.*: n=/, "n=", stats)
+    nb = split(stats, kv, " ")
+    row = backend "," run ",\"" label "\""
+    for (i = 1; i <= nb; i++)
+    {
+        sub(/^[a-z0-9]*=/, "", kv[i])
+        row = row "," kv[i]
+    }
+    print row
+}
+
+# flash <cmd>: ops=<n> bytes=<n> polls=<n>; every counter becomes a single sample
+/^flash [a-z]*: ops=/ && run != "" {
+    cmd = $2
+    sub(/:$/, "", cmd)
+    for (i = 3; i <= NF; i++)
+    {
+        split($i, kv, "=")
+        v = kv[2]
+        print backend "," run ",\"flash " cmd " " kv[1] "\",1," v "," v "," v "," v "," v
+    }
+}
@@ -0,0 +1,50 @@
+# Prints the WCET report of the CSV rows of wcet.awk: the max cycles of every
+# operation and state for every back-end, and the unbounded paths they took.
+# The max of a flagged (UNBOUNDED) operation is only the worst case observed in
+# the benchmark's states, not a bound.
+#
+# usage: awk -F, -f wcet-report.awk wcet.csv
+
+NR == 1 { next }
+
+{
+    for (i = 1; i <= NF; i++)
+        gsub(/"/, "", $i)
+    backend = $1
+    label = $3
+    if (!(backend in seen_backend))
+    {
+        seen_backend[backend] = 1
+        backends[++nb] = backend
+    }
+    if (!(label in seen_label))
+    {
+        seen_label[label] = 1
+        labels[++nl] = label
+    }
+    max[backend, label] = $6
+    if ($7 != "")
+        flags[label] = flags[label] (flags[label] == "" ? "" : "; ") backend ": " $7
+}
+
+END {
+    printf "%-40s", "max cycles of (state)"
+    for (i = 1; i <= nb; i++)
+        printf " %10s", backends[i]
+    printf "  unbounded paths\n"
+
+    for (j = 1; j <= nl; j++)
+    {
+        label = labels[j]
+        printf "%-40s", substr(label, 6)
+        for (i = 1; i <= nb; i++)
+            printf " %10s", ((backends[i], label) in max) ? max[backends[i], label] : "-"
+        if (flags[label] != "")
+        {
+            printf "  UNBOUNDED %s", flags[label]
+            nb_flagged++
+        }
+        printf "\n"
+    }
+    printf "\n%d of %d operations took an unbounded path\n", nb_flagged, nl
+}
@@ -0,0 +1,64 @@
+# Converts the text log of a WCET benchmark run (see run_wcet_benchmark() and
+# main.c) into CSV rows, one per measured label:
+#
+#   backend,state,label,n,p50,max,paths
+#
+# with the unbounded paths the label took in any run separated by spaces, or
+# empty if none; n and max summarize every measurement, whereas p50 only covers
+# the samples left in the device's ring (and is empty if none is)
+#
+# usage: awk -v backend=COFFEE -f wcet.awk wcet-COFFEE.log
+
+{ sub(/\r$/, "") }
+
+# [main] wcet benchmark: <state>
+/^\[main\] wcet benchmark:/ {
+    state = $0
+    sub(/^[^:]*: /, "", state)
+    next
+}
+
+/^cycles for wcet .*: n=/ {
+    label = $0
+    sub(/^cycles for /, "", label)
+    sub(/: n=[0-9].*$/, "", label)
+
+    # n min p50 p90 p99 max
+    stats = $0
+    sub(/^.*: n=/, "n=", stats)
+    split(stats, kv, " ")
+    for (i = 1; i <= 6; i++)
+        sub(/^[a-z0-9]*=/, "", kv[i])
+    p50[label] = kv[3]
+    next
+}
+
+# wcet for <label>: n=<n> max=<cycles> paths: <path>... | none
+/^wcet for .*: n=/ {
+    label = $0
+    sub(/^wcet for /, "", label)
+    sub(/: n=[0-9].*$/, "", label)
+    stats = $0
+    sub(/^.*: n=/, "n=", stats)
+    split(stats, kv, " ")
+    sub(/^n=/, "", kv[1])
+    sub(/^max=/, "", kv[2])
+    n[label] = kv[1]
+    max[label] = kv[2]
+    states[label] = state
+    order[++nb] = label
+    p = $0
+    sub(/^.* paths: /, "", p)
+    paths[label] = (p == "none") ? "" : p
+}
+
+END {
+    for (i = 1; i <= nb; i++)
+    {
+        label = order[i]
+        q = label
+        gsub(/"/, "\"\"", q)
+        print backend ",\"" states[label] "\",\"" q "\"," n[label] "," p50[label] "," \
+            max[label] "," paths[label]
+    }
+}
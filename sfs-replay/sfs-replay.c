@@ -0,0 +1,269 @@
+/**
+ * A host-side replayer for SFS call traces: feeds the "sfs trace:" lines of an
+ * SFS_TRACE build's output (see dump_sfs_trace() in sfs-benchmark/main.c) into
+ * the host build of the SFS front-end with any back-end, and reports the
+ * throughput and per-op latency distribution.
+ *
+ * Every distinct caller of the trace is played by one of the replay modules
+ * below, such that the front-end sees a distinct caller id per recorded SM;
+ * SMs that are only granted permissions get an id no module has. File
+ * descriptors are translated from the recorded to the replayed ones. A call
+ * diverged when it failed in the recording but not in the replay, or the
+ * other way around.
+ *
+ * usage: sfs-replay [trace]
+ */
+#include "../common.h"
+#include "../benchmark.h"
+#include "../sfs/sfs.h"
+
+// the number of distinct callers a trace may have
+#define REPLAY_NB_SMS           4
+// the number of distinct SM ids a trace may have, callers or not
+#define REPLAY_MAX_IDS          32
+// recorded file descriptors below this bound are translated
+#define REPLAY_MAX_FD           64
+
+#define REPLAY_NB_OPS           (SFS_TRACE_PUTC_RUN + 1)
+
+// the byte written by replayed putc calls, as traces hold no file data
+#define REPLAY_CHAR             'x'
+
+const char *replay_op_names[REPLAY_NB_OPS] = {"sfs_open", "sfs_close",
+    "sfs_getc", "sfs_putc", "sfs_seek", "sfs_pread", "sfs_pwrite", "sfs_chmod",
+    "sfs_remove", "getc_run", "putc_run"};
+
+struct sfs_trace_rec *trace;
+unsigned long trace_len, nb_lost;
+
+// recorded SM id -> replayed SM id; recorded fd -> replayed fd (-1 if none)
+sm_id rec_ids[REPLAY_MAX_IDS], replay_ids[REPLAY_MAX_IDS];
+int nb_ids, nb_callers;
+int fd_map[REPLAY_MAX_FD];
+
+unsigned long op_calls[REPLAY_NB_OPS], op_diverged[REPLAY_NB_OPS];
+tsc_t op_cycles[REPLAY_NB_OPS];
+
+// unprotected buffer for the replayed batch runs
+unsigned char run_buf[1 << 15];
+struct sfs_op run_op;
+
+// ############################### REPLAY MODULES #################################
+
+// the (translated) call of @p(r), timed per op; evaluates the call's return value
+#define REPLAY_CALL(r, rv) \
+do { \
+    int fd = (r->fd >= 0 && r->fd < REPLAY_MAX_FD && fd_map[r->fd] >= 0) ? \
+        fd_map[r->fd] : r->fd; \
+    switch (r->op) \
+    { \
+        case SFS_STAT_OPEN: \
+            TSC1() rv = sfs_open(r->name, r->arg1, r->arg2); TSC2("sfs_open") break; \
+        case SFS_STAT_CLOSE: \
+            TSC1() rv = sfs_close(fd); TSC2("sfs_close") break; \
+        case SFS_STAT_GETC: \
+            TSC1() rv = sfs_getc(fd); TSC2("sfs_getc") break; \
+        case SFS_STAT_PUTC: \
+            TSC1() rv = sfs_putc(fd, REPLAY_CHAR); TSC2("sfs_putc") break; \
+        case SFS_STAT_SEEK: \
+            TSC1() rv = sfs_seek(fd, r->arg1, r->arg2); TSC2("sfs_seek") break; \
+        case SFS_STAT_PREAD: \
+            TSC1() rv = sfs_pread(fd, r->arg1); TSC2("sfs_pread") break; \
+        case SFS_STAT_PWRITE: \
+            TSC1() rv = sfs_pwrite(fd, r->arg1, REPLAY_CHAR); TSC2("sfs_pwrite") break; \
+        case SFS_STAT_CHMOD: \
+            TSC1() rv = sfs_chmod(r->name, r->arg1, r->arg2); TSC2("sfs_chmod") break; \
+        case SFS_STAT_REMOVE: \
+            TSC1() rv = sfs_remove(r->name); TSC2("sfs_remove") break; \
+        default: \
+            /* a batched run, as a batch of one */ \
+            run_op.op = (r->op == SFS_TRACE_GETC_RUN) ? SFS_OP_GETC_RUN : SFS_OP_PUTC_RUN; \
+            run_op.fd = fd; \
+            run_op.arg1 = (r->arg1 > (int) sizeof(run_buf)) ? (int) sizeof(run_buf) : r->arg1; \
+            run_op.buf = run_buf; \
+            TSC1() sfs_batch(&run_op, 1); TSC2(r->op == SFS_TRACE_GETC_RUN ? \
+                "getc_run" : "putc_run") \
+            rv = run_op.rv; \
+    } \
+} while(0)
+
+#define DECLARE_REPLAY_SM(n) \
+    DECLARE_SM(replaySm##n, 0x1234); \
+    int SM_ENTRY("replaySm" #n) replay_call_##n(struct sfs_trace_rec *r) \
+    { \
+        int rv; \
+        REPLAY_CALL(r, rv); \
+        return rv; \
+    }
+
+DECLARE_REPLAY_SM(0)
+DECLARE_REPLAY_SM(1)
+DECLARE_REPLAY_SM(2)
+DECLARE_REPLAY_SM(3)
+
+struct SancusModule *replay_sms[REPLAY_NB_SMS] = {&replaySm0, &replaySm1,
+    &replaySm2, &replaySm3};
+int (*replay_calls[REPLAY_NB_SMS])(struct sfs_trace_rec *) = {replay_call_0,
+    replay_call_1, replay_call_2, replay_call_3};
+
+// ############################### TRACE PARSING ##################################
+
+int parse_op(const char *name)
+{
+    int op;
+    for (op = 0; op < REPLAY_NB_OPS; op++)
+        if (!strcmp(name, replay_op_names[op]))
+            return op;
+    return strcmp(name, "lost") ? -1 : SFS_TRACE_LOST;
+}
+
+/*
+ * Reads all "sfs trace:" lines of @p(in) into trace; other lines are skipped
+ */
+int read_trace(FILE *in)
+{
+    char line[256], op_name[32];
+    const char *p;
+    unsigned long size = 0;
+    unsigned caller;
+    int name, fd, arg1, arg2, rv, op;
+
+    while (fgets(line, sizeof(line), in))
+    {
+        if (!(p = strstr(line, "sfs trace: ")))
+            continue;
+        if (sscanf(p + 11, "%31s %u %d %d %d %d %d", op_name, &caller, &name, &fd,
+                &arg1, &arg2, &rv) != 7 || (op = parse_op(op_name)) < 0)
+        {
+            fprintf(stderr, "sfs-replay: malformed trace line: %s", p);
+            return 0;
+        }
+        if (op == SFS_TRACE_LOST)
+        {
+            nb_lost += rv;
+            continue;
+        }
+
+        if (trace_len == size)
+        {
+            size = size ? 2 * size : 1024;
+            if (!(trace = realloc(trace, size * sizeof(struct sfs_trace_rec))))
+            {
+                perror("sfs-replay");
+                return 0;
+            }
+        }
+        trace[trace_len].op = op;
+        trace[trace_len].caller_id = caller;
+        trace[trace_len].name = name;
+        trace[trace_len].fd = fd;
+        trace[trace_len].arg1 = arg1;
+        trace[trace_len].arg2 = arg2;
+        trace[trace_len].rv = rv;
+        trace_len++;
+    }
+    return 1;
+}
+
+/*
+ * Returns the replayed id of the recorded SM id @p(id); the callers take the
+ * ids of the replay modules (in order of appearance), other SMs take ids no
+ * module has
+ */
+sm_id map_id(sm_id id, int is_caller)
+{
+    int i;
+    for (i = 0; i < nb_ids; i++)
+        if (rec_ids[i] == id)
+            return replay_ids[i];
+    if (nb_ids == REPLAY_MAX_IDS || (is_caller && nb_callers == REPLAY_NB_SMS))
+    {
+        fprintf(stderr, "sfs-replay: too many distinct %s in the trace\n",
+            is_caller ? "callers" : "SM ids");
+        exit(EXIT_FAILURE);
+    }
+    rec_ids[nb_ids] = id;
+    replay_ids[nb_ids] = is_caller ? replay_sms[nb_callers++]->id :
+        replay_sms[REPLAY_NB_SMS - 1]->id + 1 + nb_ids;
+    return replay_ids[nb_ids++];
+}
+
+// the index of the replay module with the given id, if any
+int caller_index(sm_id replay_id)
+{
+    int i;
+    for (i = 0; i < nb_callers; i++)
+        if (replay_sms[i]->id == replay_id)
+            return i;
+    return -1;
+}
+
+// ############################### MAIN ###########################################
+
+int main(int argc, char **argv)
+{
+    FILE *in = stdin;
+    unsigned long i, nb_diverged = 0;
+    tsc_t total = 0;
+    int op, rv, sm;
+
+    if (argc > 1 && !(in = fopen(argv[1], "r")))
+    {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+    if (!read_trace(in))
+        return EXIT_FAILURE;
+
+    sancus_enable(&sfs);
+    for (sm = 0; sm < REPLAY_NB_SMS; sm++)
+        sancus_enable(replay_sms[sm]);
+    for (i = 0; i < REPLAY_MAX_FD; i++)
+        fd_map[i] = -1;
+
+    // every caller must be a replay module, also when it is a chmod target first
+    for (i = 0; i < trace_len; i++)
+        trace[i].caller_id = map_id(trace[i].caller_id, 1);
+    for (i = 0; i < trace_len; i++)
+        if (trace[i].op == SFS_STAT_CHMOD)
+            trace[i].arg1 = map_id(trace[i].arg1, 0);
+
+    sfs_init();
+    tsc_calibrate();
+    tsc_reset();
+    for (i = 0; i < trace_len; i++)
+    {
+        struct sfs_trace_rec *r = &trace[i];
+        if ((sm = caller_index(r->caller_id)) < 0)
+            continue;
+        rv = replay_calls[sm](r);
+
+        op = r->op;
+        op_calls[op]++;
+        op_cycles[op] += the_diff;
+        if ((rv < 0) != (r->rv < 0))
+        {
+            op_diverged[op]++;
+            nb_diverged++;
+        }
+        if (op == SFS_STAT_OPEN && r->rv >= 0 && r->rv < REPLAY_MAX_FD)
+            fd_map[r->rv] = rv;
+        else if (op == SFS_STAT_CLOSE && r->fd >= 0 && r->fd < REPLAY_MAX_FD && rv >= 0)
+            fd_map[r->fd] = -1;
+    }
+
+    for (op = 0; op < REPLAY_NB_OPS; op++)
+        total += op_cycles[op];
+    printf("replayed %lu calls of %d SM(s); %lu lost in the recording, %lu diverged\n",
+        trace_len, nb_callers, nb_lost, nb_diverged);
+    printf("throughput: %llu cycles, %.2f calls per 1000 cycles\n",
+        (unsigned long long) total, total ? 1000.0 * trace_len / total : 0.0);
+    for (op = 0; op < REPLAY_NB_OPS; op++)
+        if (op_calls[op])
+            printf("calls of %s: n=%lu diverged=%lu avg=%llu\n", replay_op_names[op],
+                op_calls[op], op_diverged[op],
+                (unsigned long long) (op_cycles[op] / op_calls[op]));
+    tsc_dump();
+
+    return EXIT_SUCCESS;
+}
@@ -56,8 +56,19 @@
  */
 #define COFFEE_SECTOR_SIZE		65536UL // 256 (pages/sector) * 256 (bytes/page)
 #define COFFEE_PAGE_SIZE		256UL
+#define COFFEE_FLASH_SIZE       2097152UL
+/*
+ * the space kept out of Coffee at the end of the chip (none by default); the
+ * raw flash benchmark (see sfs-benchmark) reserves a sector there, which it
+ * erases and programs directly without corrupting a formatted file system
+ */
+#ifdef COFFEE_CONF_RESERVED_SIZE
+#define COFFEE_RESERVED_SIZE    COFFEE_CONF_RESERVED_SIZE
+#else
+#define COFFEE_RESERVED_SIZE    0
+#endif
 #define COFFEE_START			0 // TODO COFFEE_SECTOR_SIZE
-#define COFFEE_SIZE			    (2097152UL - COFFEE_START)
+#define COFFEE_SIZE			    (COFFEE_FLASH_SIZE - COFFEE_RESERVED_SIZE - COFFEE_START)
 #define COFFEE_NAME_LENGTH		2       // TODO these parameters should match those of the SFS front-end --> include sfs-config.h
 #define COFFEE_MAX_OPEN_FILES   6      
 #define COFFEE_FD_SET_SIZE		8
@@ -68,6 +79,18 @@
 #define COFFEE_DYN_SIZE         4*1024
 #endif
 #define COFFEE_LOG_SIZE			1024
+// only program the changed bytes of file headers (saves SPI traffic)
+#ifdef COFFEE_CONF_PROGRAM_SKIP
+#define COFFEE_PROGRAM_SKIP     COFFEE_CONF_PROGRAM_SKIP
+#else
+#define COFFEE_PROGRAM_SKIP     1
+#endif
+// how cfs_coffee_format() clears the flash (see cfs-coffee.h)
+#ifdef COFFEE_CONF_FORMAT_MODE
+#define COFFEE_FORMAT_MODE      COFFEE_CONF_FORMAT_MODE
+#else
+#define COFFEE_FORMAT_MODE      COFFEE_FORMAT_LAZY
+#endif
 
 #define COFFEE_IO_SEMANTICS		1
 #define COFFEE_APPEND_ONLY		0
@@ -79,6 +102,11 @@
         sf_program_page(COFFEE_START + (offset), (char *)(buf), (size))
 		//xmem_pwrite((char *)(buf), (size), COFFEE_START + (offset))
 
+#if COFFEE_PROGRAM_SKIP
+#define COFFEE_WRITE_CHANGED(buf, size, offset)				\
+        sf_program_changed(COFFEE_START + (offset), (char *)(buf), (size))
+#endif
+
 #define COFFEE_READ(buf, size, offset)				\
         sf_read(COFFEE_START + (offset),  (char *)(buf), (size))
   		//xmem_pread((char *)(buf), (size), COFFEE_START + (offset))
@@ -87,6 +115,12 @@
         sf_sector_erase(COFFEE_START + (sector_nb) * COFFEE_SECTOR_SIZE)
   		//xmem_erase(COFFEE_SECTOR_SIZE, COFFEE_START + (sector) * COFFEE_SECTOR_SIZE)
 
+// only valid when Coffee owns the entire flash chip
+#if COFFEE_START == 0 && COFFEE_SIZE == COFFEE_FLASH_SIZE
+#define COFFEE_ERASE_ALL()                      \
+        sf_bulk_erase()
+#endif
+
 // jo: for testing purposes
 #define COFFEE_READ_ID(buf_ptr, buf_size)                 \
         sf_read_id(buf_ptr, buf_size)
@@ -82,6 +82,7 @@ do { \
 #include "cfs.h"
 #include "cfs-coffee-arch.h"
 #include "cfs-coffee.h"
+#include "../sfs-prof.h"
 
 /* Micro logs enable modifications on storage types that do not support
    in-place updates. This applies primarily to flash memories. */
@@ -114,6 +115,23 @@ do { \
 #define COFFEE_EXTENDED_WEAR_LEVELLING  1
 #endif
 
+/*
+ * Headers are mostly rewritten to set a single flag bit. If the platform
+ * can skip programming unchanged bytes, use that for header updates.
+ */
+#ifndef COFFEE_WRITE_CHANGED
+#define COFFEE_WRITE_CHANGED(buf, size, offset) COFFEE_WRITE(buf, size, offset)
+#endif
+
+/* The way cfs_coffee_format() clears the storage. */
+#ifndef COFFEE_FORMAT_MODE
+#define COFFEE_FORMAT_MODE COFFEE_FORMAT_SECTORS
+#endif
+
+#if COFFEE_FORMAT_MODE == COFFEE_FORMAT_BULK && !defined(COFFEE_ERASE_ALL)
+#error "COFFEE_FORMAT_BULK requires the platform to define COFFEE_ERASE_ALL()."
+#endif
+
 #if COFFEE_START & (COFFEE_SECTOR_SIZE - 1)
 #error COFFEE_START must point to the first byte in a sector.
 #endif
@@ -241,17 +259,81 @@ static struct file_desc *const coffee_fd_set = protected_mem.coffee_fd_set;
 static coffee_page_t *const next_free = &protected_mem.next_free;
 static char *const gc_wait = &protected_mem.gc_wait;
 
+/*
+ * The number of file descriptors and of referenced files in use, and their
+ * high-water marks.
+ */
+static unsigned nb_fds_used, nb_files_used;
+static unsigned max_fds_used, max_files_used;
+
+#define USE_FD() do { \
+  if(++nb_fds_used > max_fds_used) { \
+    max_fds_used = nb_fds_used; \
+  } \
+} while(0)
+
+#define REFERENCE_FILE(file) do { \
+  if((file)->references++ == 0 && ++nb_files_used > max_files_used) { \
+    max_files_used = nb_files_used; \
+  } \
+} while(0)
+
+#if COFFEE_FORMAT_MODE == COFFEE_FORMAT_LAZY
+/* Sectors that still hold data from before the last (lazy) format. */
+static uint8_t erase_pending[(COFFEE_SECTOR_COUNT + 7) / 8];
+
+#define SECTOR_OF(page)   ((page) / COFFEE_PAGES_PER_SECTOR)
+#define ERASE_PENDING(sector) \
+  (erase_pending[(sector) >> 3] & (1 << ((sector) & 7)))
+#define CLEAR_ERASE_PENDING(sector) \
+  (erase_pending[(sector) >> 3] &= ~(1 << ((sector) & 7)))
+#endif
+/*---------------------------------------------------------------------------*/
+static void
+erase_sector(uint16_t sector)
+{
+  COFFEE_ERASE(sector);
+#if COFFEE_FORMAT_MODE == COFFEE_FORMAT_LAZY
+  CLEAR_ERASE_PENDING(sector);
+#endif
+}
+/*---------------------------------------------------------------------------*/
+#if COFFEE_FORMAT_MODE == COFFEE_FORMAT_LAZY
+static void
+erase_pending_sectors(coffee_page_t start, coffee_page_t pages)
+{
+  uint16_t sector;
+
+  /* Erase any stale sector before the extent is first written to. */
+  for(sector = SECTOR_OF(start); sector <= SECTOR_OF(start + pages - 1);
+      sector++) {
+    if(ERASE_PENDING(sector)) {
+      erase_sector(sector);
+      PRINTF(COFFEE_STR "Erased stale sector %u on demand\n", sector);
+    }
+  }
+}
+#endif
 /*---------------------------------------------------------------------------*/
 static void
 write_header(struct file_header *hdr, coffee_page_t page)
 {
+  SFS_PROF_SCOPE(SFS_LAYER_META)
   hdr->flags |= HDR_FLAG_VALID;
-  COFFEE_WRITE(hdr, sizeof(*hdr), page * COFFEE_PAGE_SIZE);
+  COFFEE_WRITE_CHANGED(hdr, sizeof(*hdr), page * COFFEE_PAGE_SIZE);
 }
 /*---------------------------------------------------------------------------*/
 static void
 read_header(struct file_header *hdr, coffee_page_t page)
 {
+  SFS_PROF_SCOPE(SFS_LAYER_META)
+#if COFFEE_FORMAT_MODE == COFFEE_FORMAT_LAZY
+  /* A stale sector is logically erased. */
+  if(ERASE_PENDING(SECTOR_OF(page))) {
+    memset(hdr, 0, sizeof(*hdr));
+    return;
+  }
+#endif
   COFFEE_READ(hdr, sizeof(*hdr), page * COFFEE_PAGE_SIZE);
 #if DEBUG
   if(HDR_ACTIVE(*hdr) && !HDR_VALID(*hdr)) {
@@ -388,10 +470,12 @@ isolate_pages(coffee_page_t start, coffee_page_t skip_pages)
 static void
 collect_garbage(int mode)
 {
+  SFS_PROF_SCOPE(SFS_LAYER_META)
   uint16_t sector;
   struct sector_status stats;
   coffee_page_t first_page, isolation_count;
 
+  SFS_PROF_PATH(SFS_PATH_GC)
   PRINTF(COFFEE_STR "Running the file system garbage collector in %s mode\n",
          mode == GC_RELUCTANT ? "reluctant" : "greedy");
   /*
@@ -419,7 +503,7 @@ collect_garbage(int mode)
         isolate_pages(first_page + COFFEE_PAGES_PER_SECTOR, isolation_count);
       }
 
-      COFFEE_ERASE(sector);
+      erase_sector(sector);
       PRINTF(COFFEE_STR "Erased sector %d!\n", sector);
 
       if(mode == GC_RELUCTANT && isolation_count > 0) {
@@ -495,6 +579,7 @@ load_file(coffee_page_t start, struct file_header *hdr)
 static struct file *
 find_file(const char *name)
 {
+  SFS_PROF_SCOPE(SFS_LAYER_META)
   int i;
   struct file_header hdr;
   coffee_page_t page;
@@ -512,6 +597,7 @@ find_file(const char *name)
   }
 
   /* Scan the flash memory sequentially otherwise. */
+  SFS_PROF_PATH(SFS_PATH_FLASH_SCAN)
   for(page = 0; page < COFFEE_PAGE_COUNT; page = next_file(page, &hdr)) {
     read_header(&hdr, page);
     if(HDR_ACTIVE(hdr) && !HDR_LOG(hdr) && strcmp(name, hdr.name) == 0) {
@@ -525,11 +611,13 @@ find_file(const char *name)
 static cfs_offset_t
 file_end(coffee_page_t start)
 {
+  SFS_PROF_SCOPE(SFS_LAYER_META)
   struct file_header hdr;
   unsigned char buf[COFFEE_PAGE_SIZE];
   coffee_page_t page;
   int i;
 
+  SFS_PROF_PATH(SFS_PATH_FLASH_SCAN)
   read_header(&hdr, start);
 
   /*
@@ -559,9 +647,11 @@ file_end(coffee_page_t start)
 static coffee_page_t
 find_contiguous_pages(coffee_page_t amount)
 {
+  SFS_PROF_SCOPE(SFS_LAYER_META)
   coffee_page_t page, start;
   struct file_header hdr;
 
+  SFS_PROF_PATH(SFS_PATH_FLASH_SCAN)
   start = INVALID_PAGE;
   for(page = *next_free; page < COFFEE_PAGE_COUNT;) {
     read_header(&hdr, page);
@@ -596,6 +686,7 @@ static int
 remove_by_page(coffee_page_t page, int remove_log, int close_fds,
                int gc_allowed)
 {
+  SFS_PROF_SCOPE(SFS_LAYER_META)
   struct file_header hdr;
   int i;
 
@@ -619,6 +710,9 @@ remove_by_page(coffee_page_t page, int remove_log, int close_fds,
   if(close_fds) {
     for(i = 0; i < COFFEE_FD_SET_SIZE; i++) {
       if(coffee_fd_set[i].file != NULL && coffee_fd_set[i].file->page == page) {
+        if(coffee_fd_set[i].flags != COFFEE_FD_FREE) {
+          nb_fds_used--;
+        }
         coffee_fd_set[i].flags = COFFEE_FD_FREE;
       }
     }
@@ -626,6 +720,9 @@ remove_by_page(coffee_page_t page, int remove_log, int close_fds,
 
   for(i = 0; i < COFFEE_MAX_OPEN_FILES; i++) {
     if(coffee_files[i].page == page) {
+      if(!FILE_UNREFERENCED(&coffee_files[i])) {
+        nb_files_used--;
+      }
       coffee_files[i].page = INVALID_PAGE;
       coffee_files[i].references = 0;
       coffee_files[i].max_pages = 0;
@@ -652,6 +749,7 @@ static struct file *
 reserve(const char *name, coffee_page_t pages,
         int allow_duplicates, unsigned flags)
 {
+  SFS_PROF_SCOPE(SFS_LAYER_META)
   struct file_header hdr;
   coffee_page_t page;
   struct file *file;
@@ -673,6 +771,10 @@ reserve(const char *name, coffee_page_t pages,
     }
   }
 
+#if COFFEE_FORMAT_MODE == COFFEE_FORMAT_LAZY
+  erase_pending_sectors(page, pages);
+#endif
+
   memset(&hdr, 0, sizeof(hdr));
   strncpy(hdr.name, name, sizeof(hdr.name) - 1);
   hdr.max_pages = pages;
@@ -739,7 +841,7 @@ get_record_index(coffee_page_t log_page, uint16_t search_records,
   {
     //XXX uint16_t indices[batch_size];
     uint16_t *indices;
-    DO_MALLOC(indices, batch_size);
+    DO_MALLOC(indices, batch_size * sizeof(indices[0]));
 
     while(processed < search_records && match_index < 0) {
       if(batch_size + processed > search_records) {
@@ -747,7 +849,7 @@ get_record_index(coffee_page_t log_page, uint16_t search_records,
       }
 
       base -= batch_size * sizeof(indices[0]);
-      COFFEE_READ(&indices, sizeof(indices[0]) * batch_size, base);
+      COFFEE_READ(indices, sizeof(indices[0]) * batch_size, base);
 
       for(i = batch_size - 1; i >= 0; i--) {
         if(indices[i] - 1 == region) {
@@ -758,6 +860,7 @@ get_record_index(coffee_page_t log_page, uint16_t search_records,
 
       processed += batch_size;
     }
+    free(indices);
   }
 
   return match_index;
@@ -831,6 +934,7 @@ merge_log(coffee_page_t file_page, int extend)
   struct file *new_file;
   int i;
 
+  SFS_PROF_PATH(SFS_PATH_MERGE_LOG)
   read_header(&hdr, file_page);
 
   fd = cfs_open(hdr.name, CFS_READ, 0);
@@ -853,9 +957,11 @@ merge_log(coffee_page_t file_page, int extend)
   do {
     //XXX char buf[hdr.log_record_size == 0 ? COFFEE_PAGE_SIZE : hdr.log_record_size];
     char *buf;
-    DO_MALLOC(buf, (hdr.log_record_size == 0 ? COFFEE_PAGE_SIZE : hdr.log_record_size));
-    n = cfs_read(fd, buf, sizeof(buf));
+    unsigned int buf_size = hdr.log_record_size == 0 ? COFFEE_PAGE_SIZE : hdr.log_record_size;
+    DO_MALLOC(buf, buf_size);
+    n = cfs_read(fd, buf, buf_size);
     if(n < 0) {
+      free(buf);
       remove_by_page(new_file->page, !REMOVE_LOG, !CLOSE_FDS, ALLOW_GC);
       cfs_close(fd);
       return -1;
@@ -863,13 +969,14 @@ merge_log(coffee_page_t file_page, int extend)
       COFFEE_WRITE(buf, n, absolute_offset(new_file->page, offset));
       offset += n;
     }
+    free(buf);
   } while(n != 0);
 
   for(i = 0; i < COFFEE_FD_SET_SIZE; i++) {
     if(coffee_fd_set[i].flags != COFFEE_FD_FREE &&
        coffee_fd_set[i].file->page == file_page) {
       coffee_fd_set[i].file = new_file;
-      new_file->references++;
+      REFERENCE_FILE(new_file);
     }
   }
 
@@ -910,7 +1017,7 @@ find_next_record(struct file *file, coffee_page_t log_page,
     /* The next log record is unknown at this point; search for it. */
     //XXX uint16_t indices[preferred_batch_size];
     uint16_t *indices;
-    DO_MALLOC(indices, preferred_batch_size);
+    DO_MALLOC(indices, preferred_batch_size * sizeof(indices[0]));
     uint16_t processed;
     uint16_t batch_size;
 
@@ -919,7 +1026,7 @@ find_next_record(struct file *file, coffee_page_t log_page,
       batch_size = log_records - processed >= preferred_batch_size ?
         preferred_batch_size : log_records - processed;
 
-      COFFEE_READ(&indices, batch_size * sizeof(indices[0]),
+      COFFEE_READ(indices, batch_size * sizeof(indices[0]),
                   absolute_offset(log_page, processed * sizeof(indices[0])));
       for(log_record = 0; log_record < batch_size; log_record++) {
         if(indices[log_record] == 0) {
@@ -928,6 +1035,7 @@ find_next_record(struct file *file, coffee_page_t log_page,
         }
       }
     }
+    free(indices);
   }
 
   return log_record;
@@ -985,7 +1093,7 @@ write_log_page(struct file *file, struct log_param *lp)
 
     if((lp->offset > 0 || lp->size != log_record_size) &&
        read_log_page(&hdr, log_record, &lp_out) < 0) {
-      COFFEE_READ(copy_buf, sizeof(copy_buf),
+      COFFEE_READ(copy_buf, log_record_size,
                   absolute_offset(file->page, offset));
     }
 
@@ -1001,9 +1109,10 @@ write_log_page(struct file *file, struct log_param *lp)
                  offset + log_record * sizeof(region));
 
     offset += log_records * sizeof(region);
-    COFFEE_WRITE(copy_buf, sizeof(copy_buf),
+    COFFEE_WRITE(copy_buf, log_record_size,
                  offset + log_record * log_record_size);
     file->record_count = log_record + 1;
+    free(copy_buf);
   }
 
   return lp->size;
@@ -1023,10 +1132,12 @@ get_available_fd(void)
   return -1;
 }
 /*---------------------------------------------------------------------------*/
+/*---------------------------------------------------------------------------*/
 //XXX added an initial size hint argument that is ignored
 int
 cfs_open(const char *name, int flags, unsigned int size)
 {
+  SFS_PROF_SCOPE(SFS_LAYER_CFS)
   int fd;
   struct file_desc *fdp;
 
@@ -1055,7 +1166,8 @@ cfs_open(const char *name, int flags, unsigned int size)
 
   fdp->flags |= flags;
   fdp->offset = flags & CFS_APPEND ? fdp->file->end : 0;
-  fdp->file->references++;
+  REFERENCE_FILE(fdp->file);
+  USE_FD();
 
   return fd;
 }
@@ -1063,16 +1175,21 @@ cfs_open(const char *name, int flags, unsigned int size)
 void
 cfs_close(int fd)
 {
+  SFS_PROF_SCOPE(SFS_LAYER_CFS)
   if(FD_VALID(fd)) {
     coffee_fd_set[fd].flags = COFFEE_FD_FREE;
-    coffee_fd_set[fd].file->references--;
+    if(--coffee_fd_set[fd].file->references == 0) {
+      nb_files_used--;
+    }
     coffee_fd_set[fd].file = NULL;
+    nb_fds_used--;
   }
 }
 /*---------------------------------------------------------------------------*/
 cfs_offset_t
 cfs_seek(int fd, cfs_offset_t offset, int whence)
 {
+  SFS_PROF_SCOPE(SFS_LAYER_CFS)
   struct file_desc *fdp;
   cfs_offset_t new_offset;
 
@@ -1105,6 +1222,7 @@ cfs_seek(int fd, cfs_offset_t offset, int whence)
 int
 cfs_remove(const char *name)
 {
+  SFS_PROF_SCOPE(SFS_LAYER_CFS)
   struct file *file;
 
   /*
@@ -1124,6 +1242,7 @@ cfs_remove(const char *name)
 int
 cfs_read(int fd, void *buf, unsigned size)
 {
+  SFS_PROF_SCOPE(SFS_LAYER_CFS)
   struct file_desc *fdp;
   struct file *file;
 #if COFFEE_MICRO_LOGS
@@ -1181,6 +1300,7 @@ cfs_read(int fd, void *buf, unsigned size)
 int
 cfs_write(int fd, const void *buf, unsigned size)
 {
+  SFS_PROF_SCOPE(SFS_LAYER_CFS)
   struct file_desc *fdp;
   struct file *file;
 #if COFFEE_MICRO_LOGS
@@ -1304,8 +1424,9 @@ cfs_readdir(struct cfs_dir *dir, struct cfs_dirent *record)
     read_header(&hdr, page);
     if(HDR_ACTIVE(hdr) && !HDR_LOG(hdr)) {
       coffee_page_t next_page;
-      memcpy(record->name, hdr.name, sizeof(record->name));
-      record->name[sizeof(record->name) - 1] = '\0';
+      memset(record->name, 0, sizeof(record->name));
+      memcpy(record->name, hdr.name, sizeof(hdr.name) < sizeof(record->name) ?
+             sizeof(hdr.name) : sizeof(record->name) - 1);
       record->size = file_end(page);
 
       next_page = next_file(page, &hdr);
@@ -1377,16 +1498,25 @@ cfs_coffee_set_io_semantics(int fd, unsigned flags)
 int
 cfs_coffee_format(void)
 {
+#if COFFEE_FORMAT_MODE == COFFEE_FORMAT_SECTORS
   unsigned i;
+#endif
 
   PRINTF(COFFEE_STR "Formatting %u sectors", COFFEE_SECTOR_COUNT);
 
   *next_free = 0;
 
+#if COFFEE_FORMAT_MODE == COFFEE_FORMAT_LAZY
+  /* Defer the erasure of every sector until it is first allocated. */
+  memset(erase_pending, 0xff, sizeof(erase_pending));
+#elif COFFEE_FORMAT_MODE == COFFEE_FORMAT_BULK
+  COFFEE_ERASE_ALL();
+#else
   for(i = 0; i < COFFEE_SECTOR_COUNT; i++) {
     COFFEE_ERASE(i);
     PRINTF(".");
   }
+#endif
 
   /* Formatting invalidates the file information. */
   memset(&protected_mem, 0, sizeof(protected_mem));
@@ -1406,9 +1536,31 @@ cfs_coffee_get_protected_mem(unsigned *size)
 
 int cfs_format(void)
 {
+    nb_fds_used = nb_files_used = max_fds_used = max_files_used = 0;
     return cfs_coffee_format();
 }
 
+void cfs_usage(int resource, struct cfs_usage *usage, int reset)
+{
+    usage->cur = usage->max = usage->size = 0;
+    if (resource == CFS_USAGE_FILES)
+    {
+        usage->cur = nb_files_used;
+        usage->max = max_files_used;
+        usage->size = COFFEE_MAX_OPEN_FILES;
+        if (reset)
+            max_files_used = nb_files_used;
+    }
+    else if (resource == CFS_USAGE_FDS)
+    {
+        usage->cur = nb_fds_used;
+        usage->max = max_fds_used;
+        usage->size = COFFEE_FD_SET_SIZE;
+        if (reset)
+            max_fds_used = nb_fds_used;
+    }
+}
+
 void cfs_ping(void)
 {
 #ifdef COFFEE_DEBUG
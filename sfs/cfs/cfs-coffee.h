@@ -63,6 +63,32 @@
  */
 #define CFS_COFFEE_IO_FIRM_SIZE		0x2
 
+/**
+ * Format the storage by erasing every sector one at a time.
+ *
+ * \sa cfs_coffee_format()
+ */
+#define COFFEE_FORMAT_SECTORS		0
+
+/**
+ * Format the storage with a single bulk erase command. Only available
+ * when the platform defines COFFEE_ERASE_ALL(), i.e. when Coffee owns
+ * the entire storage device.
+ *
+ * \sa cfs_coffee_format()
+ */
+#define COFFEE_FORMAT_BULK		1
+
+/**
+ * Format the storage lazily: sectors are only marked as stale and are
+ * erased on demand, when a file is first reserved in them. Stale sectors
+ * read as free until then. The stale set is kept in RAM, so a lazy format
+ * does not survive a reboot; format again after every boot.
+ *
+ * \sa cfs_coffee_format()
+ */
+#define COFFEE_FORMAT_LAZY		2
+
 /**
  * \file
  *	Header for the Coffee file system.
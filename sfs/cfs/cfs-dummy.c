@@ -9,6 +9,7 @@
  */
 
 #include "cfs.h"
+#include <stdbool.h>
 
 #ifdef CFS_BACKEND_PROTECTED
     #include <sancus/sm_support.h>
@@ -18,16 +19,36 @@
     #define SM_F(str)
 #endif
 
-int fd_count = 0;
+// closed descriptors are reused, such that the fds stay within the front-end's
+// open file cache however many times files are opened
+#define MAX_NB_DUMMY_FDS    8
+
+bool fd_used[MAX_NB_DUMMY_FDS];
+unsigned int nb_fds_used, max_fds_used;
 
 int SM_F("sfs") cfs_open(const char *name, int flags, unsigned int size)
 {
-    return fd_count++;
+    int fd;
+    for (fd = 0; fd < MAX_NB_DUMMY_FDS; fd++)
+    {
+        if (!fd_used[fd])
+        {
+            fd_used[fd] = true;
+            if (++nb_fds_used > max_fds_used)
+                max_fds_used = nb_fds_used;
+            return fd;
+        }
+    }
+    return -1;
 }
 
 void SM_F("sfs") cfs_close(int fd)
 {
-    return;
+    if (fd >= 0 && fd < MAX_NB_DUMMY_FDS && fd_used[fd])
+    {
+        fd_used[fd] = false;
+        nb_fds_used--;
+    }
 }
 
 int SM_F("sfs") cfs_read(int fd, void *buf, unsigned int len)
@@ -68,7 +89,10 @@ void SM_F("sfs") cfs_closedir(struct cfs_dir *dirp)
 int SM_F("sfs") cfs_format(void)
 {
     // restart assigning file descriptors from zero
-    fd_count = 0;
+    int fd;
+    for (fd = 0; fd < MAX_NB_DUMMY_FDS; fd++)
+        fd_used[fd] = false;
+    nb_fds_used = max_fds_used = 0;
     return 0;
 }
 
@@ -77,4 +101,16 @@ void SM_F("sfs") cfs_ping(void)
     return;
 }
 
-
+// the dummy back-end has no file structures; only its fds are reported
+void SM_F("sfs") cfs_usage(int resource, struct cfs_usage *usage, int reset)
+{
+    usage->cur = usage->max = usage->size = 0;
+    if (resource == CFS_USAGE_FDS)
+    {
+        usage->cur = nb_fds_used;
+        usage->max = max_fds_used;
+        usage->size = MAX_NB_DUMMY_FDS;
+        if (reset)
+            max_fds_used = nb_fds_used;
+    }
+}
@@ -287,6 +287,27 @@ void SM_F("sfs") cfs_ping(void);
  */
 void SM_F("sfs") cfs_dump(void);
 
+/**
+ * The back-end resources reported by cfs_usage()
+ */
+#define CFS_USAGE_FILES 0   // file structures, e.g. Coffee's cache of open files
+#define CFS_USAGE_FDS   1   // file descriptors
+
+struct cfs_usage {
+  unsigned int cur;         // entries currently in use
+  unsigned int max;         // high-water mark of cur
+  unsigned int size;        // total number of entries
+};
+
+/**
+ * [NEW FUNCTION]
+ * \brief          report the usage of a fixed size back-end resource
+ * \param resource CFS_USAGE_FILES or CFS_USAGE_FDS
+ * \param usage    filled in by the function; all zero for an unknown resource
+ * \param reset    non-zero to restart the high-water mark from the current usage
+ */
+void SM_F("sfs") cfs_usage(int resource, struct cfs_usage *usage, int reset);
+
 #endif /* CFS_H_ */
 
 /** @} */
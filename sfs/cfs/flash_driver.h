@@ -2,11 +2,16 @@
  * Low-level access function definitions for a flash disk driver.
  * (inline for performance)
  *
+ * Every operation is accounted in the unprotected sf_stats (see flash_driver.c,
+ * which must be linked in). Define FLASH_DUMMY to replace the SPI operations by
+ * the I/O independent ones of dummy_flash.c.
  */
 #ifndef FLASH_DRIVER_H
 #define FLASH_DRIVER_H
 
+#include <stdint.h>
 #include <sancus_support/spi.h>
+#include "../sfs-prof.h"
 
 #ifdef FLASH_DEBUG
     #include "../../common.h"
@@ -32,6 +37,114 @@
 // status register bit masks
 #define STATUS_WIP_MASK         0x01
 
+// the M25P16 is organized as 32 sectors of 64KB
+#define SF_SECTOR_SHIFT         16
+#define SF_NB_SECTORS           32
+
+/*
+ * Flash operation accounting, per command: the number of operations, of data
+ * bytes (excluding the command and address bytes) and of status register polls
+ * busy waiting for the command to complete; and the number of erases of every
+ * sector. The polls are accounted to the last READ/PP/SE/BE command issued.
+ */
+#define SF_STAT_READ            0
+#define SF_STAT_PP              1
+#define SF_STAT_SE              2
+#define SF_STAT_BE              3
+#define SF_STAT_RDID            4
+#define SF_NB_STAT_CMDS         5
+
+struct sf_cmd_stats {
+    unsigned long ops;
+    unsigned long bytes;
+    unsigned long polls;
+};
+
+struct sf_stats {
+    struct sf_cmd_stats cmd[SF_NB_STAT_CMDS];
+    unsigned int sector_erases[SF_NB_SECTORS];
+    uint8_t last_cmd;
+};
+
+// unprotected, such that the driver can be inlined in any SM
+extern struct sf_stats sf_stats;
+
+/**
+ * Copies the current flash statistics into @p(snapshot).
+ */
+void sf_stats_snapshot(struct sf_stats *snapshot);
+
+/**
+ * Restarts all flash statistics from zero.
+ */
+void sf_stats_reset(void);
+
+#define SF_COUNT(the_cmd, nb_bytes) \
+    do { \
+        sf_stats.cmd[the_cmd].ops++; \
+        sf_stats.cmd[the_cmd].bytes += (nb_bytes); \
+        sf_stats.last_cmd = the_cmd; \
+    } while(0)
+
+#define SF_COUNT_ERASE(addr_in_sector) \
+    sf_stats.sector_erases[((addr_in_sector) >> SF_SECTOR_SHIFT) & (SF_NB_SECTORS - 1)]++
+
+/*
+ * Coffee regards zero bits as erased, whereas the flash erases to 0xFF. All
+ * data bytes are therefore inverted by the driver. To keep the SPI transfer
+ * loops tight, this is done a word at a time after (reading) or a byte at a
+ * time in an unrolled loop (programming, the caller's buf is left untouched).
+ */
+static inline __attribute__((always_inline))
+void sf_invert_buf(void *buf, unsigned int size)
+{
+    uint8_t *b = (uint8_t*) buf;
+    uint16_t *w;
+
+    if (((uintptr_t) b & 0x1) && size)
+    {
+        *b = ~*b;
+        b++;
+        size--;
+    }
+    for (w = (uint16_t*) b; size >= 2; w++, size -= 2)
+        *w = ~*w;
+    if (size)
+        *((uint8_t*) w) = ~*((uint8_t*) w);
+}
+
+// read size raw bytes into buf; unrolled by four to reduce loop overhead
+#define SF_READ_BYTES(buf, size) \
+    do { \
+        uint8_t *cur = (uint8_t*) (buf); \
+        uint8_t *end = cur + (size); \
+        while (cur + 4 <= end) { \
+            cur[0] = spi_read_byte(); \
+            cur[1] = spi_read_byte(); \
+            cur[2] = spi_read_byte(); \
+            cur[3] = spi_read_byte(); \
+            cur += 4; \
+        } \
+        while (cur < end) \
+            *cur++ = spi_read_byte(); \
+    } while(0)
+
+// write size inverted bytes from buf; unrolled by four to reduce loop overhead
+#define SF_PROGRAM_BYTES(buf, size) \
+    do { \
+        const uint8_t *cur = (const uint8_t*) (buf); \
+        const uint8_t *end = cur + (size); \
+        while (cur + 4 <= end) { \
+            spi_write_byte(~cur[0]); \
+            spi_write_byte(~cur[1]); \
+            spi_write_byte(~cur[2]); \
+            spi_write_byte(~cur[3]); \
+            cur += 4; \
+        } \
+        while (cur < end) \
+            spi_write_byte(~*cur++); \
+    } while(0)
+
 #define sf_write_enable() \
     do { \
         spi_select(); \
@@ -42,13 +155,28 @@
 #define BLOCK_WAITING() \
     do { \
         uint8_t cur_status = sf_read_status(); \
+        sf_stats.cmd[sf_stats.last_cmd].polls++; \
         /*printdebug_int("reading status for busy waiting: 0x%x\n",cur_status);  \
         printdebug("Now busy waiting on WIP bit...");*/  \
         while ((cur_status & STATUS_WIP_MASK) == STATUS_WIP_MASK)  \
+        { \
             cur_status = sf_read_status();  \
+            sf_stats.cmd[sf_stats.last_cmd].polls++; \
+        } \
         /*printdebug_int("status WIP bit cleared now; status is %x\n", cur_status);*/ \
     } while(0)
 
+#ifdef FLASH_DUMMY
+
+uint8_t sf_read_status(void);
+void sf_read_id(uint8_t *buf, int buf_size);
+void sf_sector_erase(unsigned long addr_in_sector);
+void sf_bulk_erase(void);
+int sf_read(unsigned long start_addr, char *buf, unsigned int size);
+int sf_program_page(unsigned long start_addr, char *buf, unsigned int size);
+
+#else // FLASH_DUMMY
+
 static inline __attribute__((always_inline)) 
 uint8_t sf_read_status()
 {
@@ -66,6 +194,7 @@ void sf_read_id(uint8_t *buf, int buf_size)
     printdebug_int(FD "read id into buf with size %d\n", buf_size);
 #endif
 
+    SF_COUNT(SF_STAT_RDID, buf_size);
     spi_select();
     spi_write_byte(SPI_FLASH_RDID);
     spi_read(buf, buf_size);
@@ -77,6 +206,9 @@ void sf_read_id(uint8_t *buf, int buf_size)
 static inline __attribute__((always_inline)) 
 void sf_sector_erase(unsigned long addr_in_sector)
 {
+    SFS_PROF_SCOPE(SFS_LAYER_FLASH)
+    SF_COUNT(SF_STAT_SE, 0);
+    SF_COUNT_ERASE(addr_in_sector);
     sf_write_enable();
     spi_select();
     spi_write_byte(SPI_FLASH_SE);
@@ -91,14 +223,31 @@ void sf_sector_erase(unsigned long addr_in_sector)
     BLOCK_WAITING();
 }
 
+static inline __attribute__((always_inline)) 
+void sf_bulk_erase(void)
+{
+    SFS_PROF_SCOPE(SFS_LAYER_FLASH)
+    int i;
+    SF_COUNT(SF_STAT_BE, 0);
+    for (i = 0; i < SF_NB_SECTORS; i++)
+        sf_stats.sector_erases[i]++;
+    sf_write_enable();
+    spi_select();
+    spi_write_byte(SPI_FLASH_BE);
+    spi_deselect();
+    BLOCK_WAITING();
+}
+
 static inline __attribute__((always_inline)) 
 int sf_read(unsigned long start_addr, char *buf, unsigned int size)
 {
+    SFS_PROF_SCOPE(SFS_LAYER_FLASH)
 #ifdef FLASH_DEBUG
     printdebug_int(FD "reading %d bytes ", size);
     printdebug_long("from addr %lu\n", start_addr);
 #endif
 
+    SF_COUNT(SF_STAT_READ, size);
     spi_select();
     spi_write_byte(SPI_FLASH_READ);
     
@@ -107,19 +256,17 @@ int sf_read(unsigned long start_addr, char *buf, unsigned int size)
     spi_write_byte(start_addr >> 8);
     spi_write_byte(start_addr >> 0);
     
-    char *cur;
-    for (cur = buf; cur < buf+size; cur++) {
-        char b = spi_read_byte();
-        *cur = ~b;
-    }
+    SF_READ_BYTES(buf, size);
 
     spi_deselect();
+    sf_invert_buf(buf, size);
     return size;
 }
 
 static inline __attribute__((always_inline)) 
 int sf_program_page(unsigned long start_addr, char *buf, unsigned int size)
 {
+    SFS_PROF_SCOPE(SFS_LAYER_FLASH)
 #ifdef FLASH_DEBUG
     printdebug_int(FD "writing %d bytes", size);
     printdebug_long(" to addr %lu\n", start_addr);
@@ -132,6 +279,7 @@ int sf_program_page(unsigned long start_addr, char *buf, unsigned int size)
     if (size < 1)
         return 0;
     
+    SF_COUNT(SF_STAT_PP, size);
     sf_write_enable();
     spi_select();
     spi_write_byte(SPI_FLASH_PP);
@@ -142,12 +290,121 @@ int sf_program_page(unsigned long start_addr, char *buf, unsigned int size)
     spi_write_byte(start_addr >> 0);
     
     // write all (>= 1) data bytes
-    char *cur;
-    for (cur = buf; cur < buf+size; cur++) {
-        spi_write_byte(~*cur); // XXX inverted
-    }
+    SF_PROGRAM_BYTES(buf, size);
+    
+    spi_deselect();
+    return size;
+}
+
+#define sf_write_disable() \
+    do { \
+        spi_select(); \
+        spi_write_byte(SPI_FLASH_WRDI); \
+        spi_deselect(); \
+    } while(0)
+
+static inline __attribute__((always_inline))
+int sf_read_hs(unsigned long start_addr, uint8_t *buf, unsigned int size)
+{
+    SF_COUNT(SF_STAT_READ, size);
+    spi_select();
+    spi_write_byte(SPI_FLASH_RDHS);
+    
+    // write the 3 start address bytes (MSB to LSD)
+    spi_write_byte(start_addr >> 16);
+    spi_write_byte(start_addr >> 8);
+    spi_write_byte(start_addr >> 0);
+    
+    //write a dummy byte
+    spi_write_byte(0);
+    
+    SF_READ_BYTES(buf, size);
+
+    spi_deselect();
+    sf_invert_buf(buf, size);
+    return size;
+}
+
+static inline __attribute__((always_inline))
+char sf_read_byte(unsigned long addr)
+{
+    SF_COUNT(SF_STAT_READ, 1);
+    spi_select();
+    spi_write_byte(SPI_FLASH_READ);
+    
+    // write the 3 start address bytes (MSB to LSD)
+    spi_write_byte(addr >> 16);
+    spi_write_byte(addr >> 8);
+    spi_write_byte(addr >> 0);
+    
+    char rv = ~spi_read_byte();
+
+    spi_deselect();
+    return rv;
+}
+
+static inline __attribute__((always_inline))
+int sf_program_byte(unsigned long addr, uint8_t b)
+{
+    SF_COUNT(SF_STAT_PP, 1);
+    sf_write_enable();
+    spi_select();
+    spi_write_byte(SPI_FLASH_PP);
+    
+    // write the 3 start address bytes (MSB to LSD)
+    spi_write_byte(addr >> 16);
+    spi_write_byte(addr >> 8);
+    spi_write_byte(addr >> 0);
     
+    spi_write_byte(~b);
     spi_deselect();
+    return 1;
+}
+
+#endif // FLASH_DUMMY
+
+// the number of bytes compared at once by sf_program_changed()
+#ifndef SF_DIFF_CHUNK_SIZE
+#define SF_DIFF_CHUNK_SIZE      16
+#endif
+
+/*
+ * Program only the byte ranges of buf that differ from the current flash
+ * contents. Programming can only clear (physical) bits, so rewriting bytes
+ * that already hold the wanted value is wasted SPI traffic and program time;
+ * this mainly pays off for metadata that is updated a flag bit at a time.
+ * The range should lie within a single flash page (as for sf_program_page).
+ */
+static inline __attribute__((always_inline))
+int sf_program_changed(unsigned long start_addr, char *buf, unsigned int size)
+{
+    SFS_PROF_SCOPE(SFS_LAYER_FLASH)
+    char cur[SF_DIFF_CHUNK_SIZE];
+    unsigned int done, chunk, i, run;
+
+    for (done = 0; done < size; done += chunk)
+    {
+        chunk = size - done;
+        if (chunk > SF_DIFF_CHUNK_SIZE)
+            chunk = SF_DIFF_CHUNK_SIZE;
+
+        // a preceding program operation must have completed before reading
+        BLOCK_WAITING();
+        sf_read(start_addr + done, cur, chunk);
+
+        for (i = 0; i < chunk; i += run)
+        {
+            if (cur[i] == buf[done + i])
+            {
+                run = 1;
+                continue;
+            }
+            for (run = 1; i + run < chunk && cur[i + run] != buf[done + i + run]; run++)
+                ;
+            sf_program_page(start_addr + done + i, buf + done + i, run);
+            BLOCK_WAITING();
+        }
+    }
     return size;
 }
 
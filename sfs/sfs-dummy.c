@@ -3,6 +3,12 @@
 
 DECLARE_SM(sfs, 0x1234);
 
+#ifdef SFS_WCET
+    #include <stdint.h>
+    // no back-end, so no unbounded paths (see sfs-prof.h)
+    uint8_t sfs_wcet_paths;
+#endif
+
 void SM_ENTRY("sfs") sfs_ping(void)
 {
     return;
@@ -48,6 +54,16 @@ int SM_ENTRY("sfs") sfs_seek(int fd, int offset, int whence)
     return 0;
 }
 
+int SM_ENTRY("sfs") sfs_pread(int fd, int offset)
+{
+    return 1;
+}
+
+int SM_ENTRY("sfs") sfs_pwrite(int fd, int offset, unsigned char c)
+{
+    return 1;
+}
+
 int SM_ENTRY("sfs") sfs_remove(filename_t name)
 {
     return 0;
@@ -62,3 +78,35 @@ int SM_ENTRY("sfs") sfs_attest(filename_t name, sm_id owner)
 {
     return 0;
 }
+
+int SM_ENTRY("sfs") sfs_batch(struct sfs_op *ops, int nb_ops)
+{
+    return nb_ops;
+}
+
+int SM_ENTRY("sfs") sfs_set_key(int fd, int idx, unsigned int word)
+{
+    return 0;
+}
+
+int SM_ENTRY("sfs") sfs_read_sealed(int fd, unsigned char *cipher,
+    unsigned int len, unsigned char *tag)
+{
+    return len;
+}
+
+int SM_ENTRY("sfs") sfs_write_sealed(int fd, unsigned char *cipher,
+    unsigned int len, unsigned char *tag)
+{
+    return len;
+}
+
+int SM_ENTRY("sfs") sfs_stats(struct sfs_stats *stats, int reset)
+{
+    return 0;
+}
+
+int SM_ENTRY("sfs") sfs_trace(struct sfs_trace_rec *recs, int max_recs)
+{
+    return 0;
+}
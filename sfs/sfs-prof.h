@@ -0,0 +1,140 @@
+/**
+ * Nested scoped timers for the per-layer cycle breakdown reported by
+ * sfs_stats(); compiled in by SFS_PROFILE, else the macros expand to nothing.
+ *
+ * SFS_PROF_OP(op) at the start of an SFS entry makes op the current operation
+ * and opens a front-end (SFS_LAYER_SFS) scope; SFS_PROF_SCOPE(layer) at the
+ * start of a function of a lower layer opens a scope of that layer. A scope is
+ * closed when its enclosing block is left (through the cleanup attribute), so
+ * early returns need no special care. A closing scope adds its cycles minus
+ * those of its nested scopes to the exclusive count of its layer, and all of
+ * its cycles to the inclusive count, unless an enclosing scope of the same
+ * layer will. Scopes outside an entry call (e.g. sfs_init()) are not recorded.
+ *
+ * \note the bookkeeping of a nested scope is charged to the enclosing one
+ * \note the state is unprotected, such that an unprotected back-end and flash
+ * driver can update it; it is defined in sfs-ram.c (sfs_wcet_paths also in
+ * sfs-dummy.c). Untrusted code may thus corrupt it: every index is checked
+ * before use, such that a corrupted state only yields wrong cycle counts
+ */
+#ifndef SFS_PROF_H
+#define SFS_PROF_H
+
+#ifdef SFS_PROFILE
+
+#include <sancus/sm_support.h>
+#include <sancus_support/tsc.h>
+#include <stdint.h>
+#include "sfs.h"
+
+// the maximum number of nested scopes; deeper scopes are not recorded
+#define SFS_PROF_MAX_DEPTH      12
+#define SFS_PROF_NONE           0xff
+
+struct sfs_prof_scope {
+    uint8_t layer;
+    tsc_t start;
+    tsc_t nested;               // the cycles of the nested scopes
+};
+
+extern struct sfs_layer_stats sfs_prof_layers[SFS_NB_STAT_OPS][SFS_NB_LAYERS];
+extern struct sfs_prof_scope sfs_prof_stack[SFS_PROF_MAX_DEPTH];
+extern uint8_t sfs_prof_depth;
+extern uint8_t sfs_prof_layer_depth[SFS_NB_LAYERS];
+extern int8_t sfs_prof_op;      // the current SFS_STAT_* op; -1 outside an entry
+
+static inline __attribute__((always_inline))
+uint8_t sfs_prof_enter(uint8_t layer)
+{
+    struct sfs_prof_scope *s;
+    if (sfs_prof_op < 0 || sfs_prof_op >= SFS_NB_STAT_OPS ||
+        sfs_prof_depth >= SFS_PROF_MAX_DEPTH)
+        return SFS_PROF_NONE;
+
+    s = &sfs_prof_stack[sfs_prof_depth++];
+    s->layer = layer;
+    s->nested = 0;
+    sfs_prof_layer_depth[layer]++;
+    s->start = tsc_read();
+    return layer;
+}
+
+static inline __attribute__((always_inline))
+void sfs_prof_exit(uint8_t *layer)
+{
+    tsc_t cycles = tsc_read();
+    struct sfs_prof_scope *s;
+    struct sfs_layer_stats *l;
+    if (*layer == SFS_PROF_NONE || sfs_prof_depth == 0 ||
+        sfs_prof_depth > SFS_PROF_MAX_DEPTH || sfs_prof_op < 0 ||
+        sfs_prof_op >= SFS_NB_STAT_OPS)
+        return;
+
+    s = &sfs_prof_stack[--sfs_prof_depth];
+    cycles -= s->start;
+    l = &sfs_prof_layers[sfs_prof_op][*layer];
+    l->excl += cycles - s->nested;
+    if (--sfs_prof_layer_depth[*layer] == 0)
+        l->incl += cycles;
+    if (sfs_prof_depth)
+        sfs_prof_stack[sfs_prof_depth - 1].nested += cycles;
+}
+
+static inline __attribute__((always_inline))
+uint8_t sfs_prof_op_begin(int8_t op)
+{
+    // an entry call nested in another one is accounted to the outer op
+    if (sfs_prof_op >= 0)
+        return SFS_PROF_NONE;
+    sfs_prof_op = op;
+    return sfs_prof_enter(SFS_LAYER_SFS);
+}
+
+static inline __attribute__((always_inline))
+void sfs_prof_op_end(uint8_t *layer)
+{
+    if (*layer == SFS_PROF_NONE)
+        return;
+    sfs_prof_exit(layer);
+    sfs_prof_op = -1;
+}
+
+#define SFS_PROF_OP(op) \
+    uint8_t sfs_prof_op_scope __attribute__((cleanup(sfs_prof_op_end), unused)) = \
+        sfs_prof_op_begin(op);
+
+#define SFS_PROF_SCOPE(layer) \
+    uint8_t sfs_prof_scope __attribute__((cleanup(sfs_prof_exit), unused)) = \
+        sfs_prof_enter(layer);
+
+#else // SFS_PROFILE
+
+#define SFS_PROF_OP(op)
+#define SFS_PROF_SCOPE(layer)
+
+#endif // SFS_PROFILE
+
+/*
+ * SFS_PROF_PATH(path) marks that the running call takes one of the unbounded
+ * SFS_PATH_* paths; compiled in by SFS_WCET, else it expands to nothing. The
+ * marks accumulate in sfs_wcet_paths until its reader (e.g. the WCET benchmark)
+ * clears it, such that nested and back-end calls need no bookkeeping.
+ */
+#ifdef SFS_WCET
+
+#include <sancus/sm_support.h>
+#include <stdint.h>
+#include "sfs.h"
+
+extern uint8_t sfs_wcet_paths;
+
+#define SFS_PROF_PATH(path) \
+    sfs_wcet_paths |= (path);
+
+#else // SFS_WCET
+
+#define SFS_PROF_PATH(path)
+
+#endif // SFS_WCET
+
+#endif // SFS_PROF_H
@@ -9,9 +9,11 @@
 
 #include <sancus/sm_support.h>
 #include <stdbool.h>
+#include <limits.h>
 #include "sfs-debug.h"
 #include "sfs.h"
 #include "cfs/cfs.h"
+#include "sfs-prof.h"
 
 #ifndef SUCCESS
     #define SUCCESS         1       // a positive value, to indicate success
@@ -40,6 +42,17 @@ DECLARE_SM(sfs, 0x1234);
 #define MAX_NB_FILES            5
 // the system-wide max number of assignable file permissions; defines perm_pool size
 #define MAX_NB_PERMS            10
+// the number of calls an SFS_TRACE build keeps (a power of 2); defines trace_ring size
+#ifndef SFS_TRACE_SIZE
+    #define SFS_TRACE_SIZE      64
+#endif
+// the id of the only caller that may reset the statistics (0: unprotected code);
+// when undefined, the statistics are read-only
+//#define SFS_STATS_OWNER         0
+// the id of the only caller that may retrieve the trace (0: unprotected code)
+#if defined(SFS_TRACE) && !defined(SFS_TRACE_READER)
+    #error "an SFS_TRACE build needs the id of the trace reader (SFS_TRACE_READER)"
+#endif
 
 // ######################### GLOBAL PROTECTED DATA STRUCTURES #####################
 
@@ -86,11 +99,99 @@ struct FILE_PERM SM_DATA("sfs") *free_perm_list;
 struct OPEN_FILE SM_DATA("sfs") *free_file_list;
 struct OPEN_FILE SM_DATA("sfs") *open_file_list;
 
+// per file descriptor session keys for sealed bulk transfers, the bitmask of
+// the key words set so far, the session number and the sequence number of the
+// next sealed transfer (both bound in the associated data)
+unsigned char SM_DATA("sfs") sealed_key[MAX_NB_OPEN_FILES][SANCUS_KEY_SIZE];
+unsigned int SM_DATA("sfs") sealed_key_set[MAX_NB_OPEN_FILES];
+unsigned int SM_DATA("sfs") sealed_session[MAX_NB_OPEN_FILES];
+unsigned int SM_DATA("sfs") sealed_seq[MAX_NB_OPEN_FILES];
+// the number of the last session key completed; never reset, such that a key
+// set again (on the same or a reopened fd) never repeats the associated data
+unsigned int SM_DATA("sfs") sealed_last_session;
+
+#define SEALED_KEY_WORDS        (SANCUS_KEY_SIZE / 2)
+#define SEALED_KEY_COMPLETE     ((1U << SEALED_KEY_WORDS) - 1)
+#if SEALED_KEY_WORDS > 16
+    #error "sealed_key_set cannot hold a bit per key word"
+#endif
+
+// protected staging buffers for sealed bulk transfers; word aligned, such that
+// the back-end can copy a word at a time
+unsigned char SM_DATA("sfs") sealed_buf[SFS_SEALED_MAX_LEN] __attribute__((aligned(2)));
+unsigned char SM_DATA("sfs") sealed_tag[SANCUS_TAG_SIZE];
+
 // indicates data structures are intialized; set to false (zero) on SM creation
 bool SM_DATA("sfs") INIT_DONE;
 
+// always-on statistics reported by sfs_stats()
+unsigned long SM_DATA("sfs") op_count[SFS_NB_STAT_OPS];
+unsigned long SM_DATA("sfs") fail_count[SFS_NB_FAIL_CAUSES];
+// current and high-water usage of file_pool, perm_pool and fd_cache
+unsigned int SM_DATA("sfs") pool_used[SFS_POOL_FDS + 1];
+unsigned int SM_DATA("sfs") pool_max[SFS_POOL_FDS + 1];
+
+#ifdef SFS_PROFILE
+// unprotected scoped timer state, shared with the back-end (see sfs-prof.h)
+struct sfs_layer_stats sfs_prof_layers[SFS_NB_STAT_OPS][SFS_NB_LAYERS];
+struct sfs_prof_scope sfs_prof_stack[SFS_PROF_MAX_DEPTH];
+uint8_t sfs_prof_depth;
+uint8_t sfs_prof_layer_depth[SFS_NB_LAYERS];
+int8_t sfs_prof_op = -1;
+#endif
+
+#ifdef SFS_WCET
+// unprotected marks of the unbounded paths taken, shared with the back-end
+uint8_t sfs_wcet_paths;
+#endif
+
+#ifdef SFS_TRACE
+// the most recent calls, oldest first from trace_head; and the number of calls
+// overwritten since the previous sfs_trace()
+struct sfs_trace_rec SM_DATA("sfs") trace_ring[SFS_TRACE_SIZE];
+unsigned int SM_DATA("sfs") trace_head;
+unsigned int SM_DATA("sfs") trace_len;
+unsigned int SM_DATA("sfs") trace_lost;
+#endif
+
 // ############################# HELPER MACROS ####################################
 
+/************************* statistics *************************/
+
+// counts an entry call of op and, in an SFS_PROFILE build, times it
+#define ENTER_OP(op) \
+    op_count[op]++; \
+    SFS_PROF_OP(op)
+
+#define COUNT_FAIL(cause) \
+    fail_count[cause]++;
+
+#define POOL_ALLOC(pool) \
+do { \
+    if (++pool_used[pool] > pool_max[pool]) \
+        pool_max[pool] = pool_used[pool]; \
+} while(0)
+
+#define POOL_FREE(pool) \
+do { \
+    pool_used[pool]--; \
+} while(0)
+
+/*************************** tracing **************************/
+
+// in an SFS_TRACE build, records the call; evaluates to its return value rv.
+// TRACE_DATA is for the calls that return a file byte: only their status (0 or
+// the negative rv) is recorded
+#ifdef SFS_TRACE
+    #define TRACE(op, caller, name, fd, arg1, arg2, rv) \
+        trace_call(op, caller, name, fd, arg1, arg2, rv)
+    #define TRACE_DATA(op, caller, fd, arg1, rv) \
+        trace_data_call(op, caller, fd, arg1, rv)
+#else
+    #define TRACE(op, caller, name, fd, arg1, arg2, rv)     (rv)
+    #define TRACE_DATA(op, caller, fd, arg1, rv)            (rv)
+#endif
+
 /******************* file descriptor checks *******************/
 
 #define IS_VALID_FD(fd) \
@@ -101,6 +202,7 @@ bool SM_DATA("sfs") INIT_DONE;
     { \
         printerror_int_int("the provided file descriptor %d isn't valid or " \
             "doesn't belong to calling SM %d", fd, sm); \
+        COUNT_FAIL(SFS_FAIL_BAD_FD) \
         return FAILURE; \
     }
 
@@ -108,9 +210,22 @@ bool SM_DATA("sfs") INIT_DONE;
 do { \
     fd_cache[fd]->file->open_count--; \
     fd_cache[fd] = NULL; \
+    POOL_FREE(SFS_POOL_FDS); \
+    CLEAR_SEALED_KEY(fd); \
     cfs_close(fd); \
 } while(0)
 
+// wipe any session key, so it doesn't outlive the file descriptor
+#define CLEAR_SEALED_KEY(fd) \
+do { \
+    int k; \
+    for (k = 0; k < SANCUS_KEY_SIZE; k++) \
+        sealed_key[fd][k] = 0; \
+    sealed_key_set[fd] = 0; \
+    sealed_session[fd] = 0; \
+    sealed_seq[fd] = 0; \
+} while(0)
+
 /********************** permission checks *********************/
 
 #define CHK_PERM(p_have, p_want) \
@@ -118,6 +233,7 @@ do { \
     if ((p_have & p_want) != p_want) { \
         printerror_int_int("permission check failed p_have=0x%x ; p_want = 0x%x", \
             p_have, p_want); \
+        COUNT_FAIL(SFS_FAIL_PERM) \
         return FAILURE; \
     } \
 } while(0)
@@ -140,10 +256,12 @@ do { \
     if (!free_perm_list) \
     { \
         printerror("no more FILE_PERM structs left"); \
+        COUNT_FAIL(SFS_FAIL_POOL) \
         return FAILURE; \
     } \
     p = free_perm_list; \
     free_perm_list = free_perm_list->next; \
+    POOL_ALLOC(SFS_POOL_PERMS); \
     p->sm_id = the_id; \
     p->flags = the_flags; \
     p->file = the_file; \
@@ -154,6 +272,7 @@ do { \
 do { \
     p->next = free_perm_list; \
     free_perm_list = p; \
+    POOL_FREE(SFS_POOL_PERMS); \
 } while(0)
 
 // cur will point to the FILE_PERM struct if found; else NULL
@@ -171,10 +290,12 @@ do { \
     if (!free_file_list) \
     { \
         printerror("no more OPEN_FILE structs left"); \
+        COUNT_FAIL(SFS_FAIL_POOL) \
         return FAILURE; \
     } \
     the_file = free_file_list; \
     free_file_list = free_file_list->next; \
+    POOL_ALLOC(SFS_POOL_FILES); \
     the_file->name = the_name; \
     the_file->open_count = 0; \
     the_file->acl = the_acl; \
@@ -185,6 +306,7 @@ do { \
 do { \
     f->next = free_file_list; \
     free_file_list = f; \
+    POOL_FREE(SFS_POOL_FILES); \
 } while(0)
 
 // cur will point to the OPEN_FILE struct if found; else NULL
@@ -262,6 +384,44 @@ void SM_FUNC("sfs") init_data_structures(void)
     INIT_DONE = 1;
 }
 
+#ifdef SFS_TRACE
+/**
+ * Appends a record of a call to trace_ring, overwriting the oldest record when
+ * the ring is full, and returns the call's return value @p(rv).
+ */
+int SM_FUNC("sfs") trace_call(int op, sm_id caller_id, filename_t name, int fd,
+    int arg1, int arg2, int rv)
+{
+    struct sfs_trace_rec *r = &trace_ring[(trace_head + trace_len) & (SFS_TRACE_SIZE - 1)];
+    if (trace_len == SFS_TRACE_SIZE)
+    {
+        trace_head = (trace_head + 1) & (SFS_TRACE_SIZE - 1);
+        trace_lost++;
+    }
+    else
+        trace_len++;
+
+    r->op = op;
+    r->name = name;
+    r->caller_id = caller_id;
+    r->fd = fd;
+    r->arg1 = arg1;
+    r->arg2 = arg2;
+    r->rv = rv;
+    return rv;
+}
+
+/**
+ * Appends a record of a call that returns a file byte @p(rv) (or a negative
+ * value on failure) without the byte, and returns @p(rv).
+ */
+int SM_FUNC("sfs") trace_data_call(int op, sm_id caller_id, int fd, int arg1, int rv)
+{
+    trace_call(op, caller_id, 0, fd, arg1, 0, (rv >= 0) ? 0 : rv);
+    return rv;
+}
+#endif
+
 /**
  * Searches for the file associated with @param(name) and then checks permissions
  * @param(flags) for SM with id @param(sm). On success, zero is returned and
@@ -283,7 +443,10 @@ int SM_FUNC("sfs") two_phase_lookup_prev (filename_t name, int flags, sm_id sm,
         LOOKUP_FILE(name, file);
     
     if (!file)
+    {
+        COUNT_FAIL(SFS_FAIL_NO_FILE)
         return FAILURE;
+    }
     
     printdi_debug("found open_file struct at address %#x; now searching ACL", file);
     struct FILE_PERM *p;
@@ -291,6 +454,7 @@ int SM_FUNC("sfs") two_phase_lookup_prev (filename_t name, int flags, sm_id sm,
     if (!p)
     {
         printerror_int("found no perm entry for SM %d", sm);
+        COUNT_FAIL(SFS_FAIL_PERM)
         return FAILURE;
     }
     printdi_debug("found file_perm struct at address %#x", p);
@@ -323,10 +487,12 @@ int SM_FUNC("sfs") open_back_end_file(char name, int size, struct FILE_PERM *p)
     {
         printerror_int("returned back-end fd %d out of range", fd);
         cfs_close(fd);
+        COUNT_FAIL((fd < 0) ? SFS_FAIL_BACKEND : SFS_FAIL_POOL)
         return FAILURE;
     }
     p->file->open_count++;
     fd_cache[fd] = p;
+    POOL_ALLOC(SFS_POOL_FDS);
     
     return fd;
 }
@@ -345,6 +511,7 @@ int SM_FUNC("sfs") revoke_acl(struct OPEN_FILE *file, sm_id id)
             if (cur->flags == SFS_CREATOR)
             {
                 printerror("SFS_CREATOR permission is non-revocable");
+                COUNT_FAIL(SFS_FAIL_PERM)
                 return FAILURE;
             }
             else
@@ -382,6 +549,7 @@ int SM_FUNC("sfs") add_acl(struct OPEN_FILE *file, sm_id id, int perm_flags)
             if (p->flags == SFS_CREATOR)
             {
                 printerror("SFS_CREATOR permission is non-overrideable");
+                COUNT_FAIL(SFS_FAIL_PERM)
                 return FAILURE;
             }
             else
@@ -397,6 +565,7 @@ int SM_FUNC("sfs") add_acl(struct OPEN_FILE *file, sm_id id, int perm_flags)
     if (perm_flags == SFS_CREATOR)
     {
         printerror("SFS_CREATOR permission is non-assignable");
+        COUNT_FAIL(SFS_FAIL_PERM)
         return FAILURE;
     }
     
@@ -479,11 +648,15 @@ void SM_ENTRY("sfs") sfs_dump(void)
 #endif
 }
 
-int SM_ENTRY("sfs") sfs_open(filename_t name, int flags, int size)
+/*
+ * The SFS API implementation below is split in a thin SM_ENTRY wrapper that
+ * retrieves the caller id and initializes the data structures, and a do_fct()
+ * SM_FUNC that does the actual work for the given (already verified) caller.
+ * This allows sfs_batch() to execute several operations in a single crossing.
+ */
+
+int SM_FUNC("sfs") do_open(sm_id caller_id, filename_t name, int flags, int size)
 {
-    sm_id caller_id = sancus_get_caller_id();
-    DO_INIT()
-    
     struct OPEN_FILE *file; struct FILE_PERM *p;
     LOOKUP_FILE(name, file);
     if (!file)
@@ -492,6 +665,7 @@ int SM_ENTRY("sfs") sfs_open(filename_t name, int flags, int size)
         {
             printerror_int(FCT("sfs_open") "caller requested not to create new " \
             "non-existing file '%c'; returning failure...", (int) name);
+            COUNT_FAIL(SFS_FAIL_NO_FILE)
             return FAILURE;
         }
         printdname_info(FCT("sfs_open") "creating new file with name", name);
@@ -505,6 +679,7 @@ int SM_ENTRY("sfs") sfs_open(filename_t name, int flags, int size)
         if (!free_perm_list || !free_file_list)
         {
             printerror("need a free OPEN_FILE struct and FILE_PERM struct");
+            COUNT_FAIL(SFS_FAIL_POOL)
             return FAILURE;
         }
     
@@ -522,6 +697,7 @@ int SM_ENTRY("sfs") sfs_open(filename_t name, int flags, int size)
     if (!p)
     {
         printerror_int("found no permission entry for SM %d", caller_id);
+        COUNT_FAIL(SFS_FAIL_PERM)
         return FAILURE;
     }
     CHK_PERM(p->flags, flags); // might return failure
@@ -529,15 +705,25 @@ int SM_ENTRY("sfs") sfs_open(filename_t name, int flags, int size)
     return open_back_end_file(name, size, p);
 }
 
-int SM_ENTRY("sfs") sfs_close(int fd)
+int SM_ENTRY("sfs") sfs_open(filename_t name, int flags, int size)
 {
     sm_id caller_id = sancus_get_caller_id();
     DO_INIT()
+    ENTER_OP(SFS_STAT_OPEN)
+    
+    return TRACE(SFS_STAT_OPEN, caller_id, name, 0, flags, size,
+        do_open(caller_id, name, flags, size));
+}
+
+int SM_FUNC("sfs") do_close(sm_id caller_id, int fd)
+{
     printdi_info(FCT("sfs_close") "file with fd %d", fd);
 
     CHK_FD(fd, caller_id)    
     fd_cache[fd]->file->open_count--;
     fd_cache[fd] = NULL;
+    POOL_FREE(SFS_POOL_FDS);
+    CLEAR_SEALED_KEY(fd);
 
     TSC1()
     cfs_close(fd);
@@ -546,15 +732,22 @@ int SM_ENTRY("sfs") sfs_close(int fd)
     return SUCCESS;
 }
 
+int SM_ENTRY("sfs") sfs_close(int fd)
+{
+    sm_id caller_id = sancus_get_caller_id();
+    DO_INIT()
+    ENTER_OP(SFS_STAT_CLOSE)
+
+    return TRACE(SFS_STAT_CLOSE, caller_id, 0, fd, 0, 0, do_close(caller_id, fd));
+}
+
 /**
  * this implementation refuses to remove a file that is still open
  * by some SM; an alternative would be that the implementation closes
  * any remaining open file connection on behalf of the caller (owner of the file)
  */
-int SM_ENTRY("sfs") sfs_remove(filename_t name)
+int SM_FUNC("sfs") do_remove(sm_id caller_id, filename_t name)
 {
-    sm_id caller_id = sancus_get_caller_id();
-    DO_INIT()
     printdname_info(FCT("sfs_remove") "trying to remove file", name);
     
     // only root can remove a file
@@ -566,6 +759,7 @@ int SM_ENTRY("sfs") sfs_remove(filename_t name)
     {
         printerror_int("there are %d remaining open file connections;" \
         " close them first", cur->open_count);
+        COUNT_FAIL(SFS_FAIL_BUSY)
         return FAILURE;
     }
     
@@ -590,10 +784,17 @@ int SM_ENTRY("sfs") sfs_remove(filename_t name)
     return rv;
 }
 
-int SM_ENTRY("sfs") sfs_getc(int fd)
+int SM_ENTRY("sfs") sfs_remove(filename_t name)
 {
     sm_id caller_id = sancus_get_caller_id();
     DO_INIT()
+    ENTER_OP(SFS_STAT_REMOVE)
+
+    return TRACE(SFS_STAT_REMOVE, caller_id, name, 0, 0, 0, do_remove(caller_id, name));
+}
+
+int SM_FUNC("sfs") do_getc(sm_id caller_id, int fd)
+{
     printdi_info(FCT("sfs_getc") "read a char from file with fd %d", fd);
    
     CHK_FD(fd, caller_id)
@@ -607,10 +808,17 @@ int SM_ENTRY("sfs") sfs_getc(int fd)
     return (rv > 0)? buf : EOF;
 }
 
-int SM_ENTRY("sfs") sfs_putc(int fd, unsigned char c)
+int SM_ENTRY("sfs") sfs_getc(int fd)
 {
     sm_id caller_id = sancus_get_caller_id();
     DO_INIT()
+    ENTER_OP(SFS_STAT_GETC)
+
+    return TRACE_DATA(SFS_STAT_GETC, caller_id, fd, 0, do_getc(caller_id, fd));
+}
+
+int SM_FUNC("sfs") do_putc(sm_id caller_id, int fd, unsigned char c)
+{
     printdi_info(FCT("sfs_putc") "write a char to file with fd %d", fd);
 
     CHK_FD(fd, caller_id)
@@ -625,10 +833,17 @@ int SM_ENTRY("sfs") sfs_putc(int fd, unsigned char c)
     return (rv > 0)? buf : EOF;
 }
 
-int SM_ENTRY("sfs") sfs_seek(int fd, int offset, int origin)
+int SM_ENTRY("sfs") sfs_putc(int fd, unsigned char c)
 {
     sm_id caller_id = sancus_get_caller_id();
     DO_INIT()
+    ENTER_OP(SFS_STAT_PUTC)
+
+    return TRACE_DATA(SFS_STAT_PUTC, caller_id, fd, 0, do_putc(caller_id, fd, c));
+}
+
+int SM_FUNC("sfs") do_seek(sm_id caller_id, int fd, int offset, int origin)
+{
     printdi_info(FCT("sfs_seek") "now trying to seek in file with fd %d", fd);
     CHK_FD(fd, caller_id)
 
@@ -639,11 +854,89 @@ int SM_ENTRY("sfs") sfs_seek(int fd, int offset, int origin)
     return rv;
 }
 
-int SM_ENTRY("sfs") sfs_chmod(filename_t name, sm_id id, int perm_flags)
+int SM_ENTRY("sfs") sfs_seek(int fd, int offset, int origin)
+{
+    sm_id caller_id = sancus_get_caller_id();
+    DO_INIT()
+    ENTER_OP(SFS_STAT_SEEK)
+
+    return TRACE(SFS_STAT_SEEK, caller_id, 0, fd, offset, origin,
+        do_seek(caller_id, fd, offset, origin));
+}
+
+// positioned I/O is all or nothing: the position is only moved by a successful
+// read or write, and is restored when the seek or the read/write fails
+#define RESTORE_POS(fd, old_pos) \
+do { \
+    if (old_pos >= 0) \
+        cfs_seek(fd, old_pos, CFS_SEEK_SET); \
+} while(0)
+
+int SM_FUNC("sfs") do_pread(sm_id caller_id, int fd, int offset)
+{
+    printdii_info(FCT("sfs_pread") "read a char at offset %d from fd %d", offset, fd);
+
+    CHK_FD(fd, caller_id)
+    CHK_PERM(fd_cache[fd]->flags, SFS_READ);
+
+    TSC1()
+    cfs_offset_t old_pos = cfs_seek(fd, 0, CFS_SEEK_CUR);
+    int rv = cfs_seek(fd, offset, CFS_SEEK_SET);
+    if (rv >= 0)
+        rv = cfs_read(fd, &buf, 1);
+    if (rv <= 0)
+        RESTORE_POS(fd, old_pos);
+    TSC2("cfs_seek + cfs_read_one_char")
+
+    printdi_debug("cfs_seek/cfs_read returned %d", rv);
+    return (rv > 0)? buf : EOF;
+}
+
+int SM_ENTRY("sfs") sfs_pread(int fd, int offset)
 {
     sm_id caller_id = sancus_get_caller_id();
     DO_INIT()
+    ENTER_OP(SFS_STAT_PREAD)
 
+    return TRACE_DATA(SFS_STAT_PREAD, caller_id, fd, offset,
+        do_pread(caller_id, fd, offset));
+}
+
+int SM_FUNC("sfs") do_pwrite(sm_id caller_id, int fd, int offset, unsigned char c)
+{
+    printdii_info(FCT("sfs_pwrite") "write a char at offset %d to fd %d", offset, fd);
+
+    CHK_FD(fd, caller_id)
+    CHK_PERM(fd_cache[fd]->flags, SFS_WRITE);
+
+    TSC1()
+    cfs_offset_t old_pos = cfs_seek(fd, 0, CFS_SEEK_CUR);
+    int rv = cfs_seek(fd, offset, CFS_SEEK_SET);
+    if (rv >= 0)
+    {
+        buf = c;
+        rv = cfs_write(fd, &buf, 1);
+    }
+    if (rv <= 0)
+        RESTORE_POS(fd, old_pos);
+    TSC2("cfs_seek + cfs_write_one_char")
+
+    printdi_debug("cfs_seek/cfs_write returned %d", rv);
+    return (rv > 0)? buf : EOF;
+}
+
+int SM_ENTRY("sfs") sfs_pwrite(int fd, int offset, unsigned char c)
+{
+    sm_id caller_id = sancus_get_caller_id();
+    DO_INIT()
+    ENTER_OP(SFS_STAT_PWRITE)
+
+    return TRACE_DATA(SFS_STAT_PWRITE, caller_id, fd, offset,
+        do_pwrite(caller_id, fd, offset, c));
+}
+
+int SM_FUNC("sfs") do_chmod(sm_id caller_id, filename_t name, sm_id id, int perm_flags)
+{
     printdname_info(FCT("sfs_chmod") "trying to modify ACL for file", name);
     printdi_debug("wanted permission entry for SM %d", id);
     printdi_debug("and flags %#x", perm_flags);
@@ -658,6 +951,16 @@ int SM_ENTRY("sfs") sfs_chmod(filename_t name, sm_id id, int perm_flags)
     return add_acl(p_caller->file, id, perm_flags);
 }
 
+int SM_ENTRY("sfs") sfs_chmod(filename_t name, sm_id id, int perm_flags)
+{
+    sm_id caller_id = sancus_get_caller_id();
+    DO_INIT()
+    ENTER_OP(SFS_STAT_CHMOD)
+
+    return TRACE(SFS_STAT_CHMOD, caller_id, name, 0, id, perm_flags,
+        do_chmod(caller_id, name, id, perm_flags));
+}
+
 int SM_ENTRY("sfs") sfs_attest(filename_t name, sm_id owner)
 {
     printdii_info(FCT("sfs_attest") "validating file '%c' was created by SM %d",
@@ -676,3 +979,390 @@ int SM_ENTRY("sfs") sfs_attest(filename_t name, sm_id owner)
     
     return SUCCESS;
 }
+
+/*
+ * The run operations check the file descriptor and permissions once and then
+ * transfer the chars one at a time through the protected buf.
+ */
+int SM_FUNC("sfs") do_getc_run(sm_id caller_id, int fd, unsigned char *to, int len)
+{
+    printdii_info(FCT("sfs_batch") "getc run of %d chars from fd %d", len, fd);
+    CHK_FD(fd, caller_id)
+    CHK_PERM(fd_cache[fd]->flags, SFS_READ);
+
+    int i;
+    for (i = 0; i < len; i++)
+    {
+        if (cfs_read(fd, &buf, 1) <= 0)
+            break;
+        to[i] = buf;
+    }
+    return i;
+}
+
+int SM_FUNC("sfs") do_putc_run(sm_id caller_id, int fd, unsigned char *from, int len)
+{
+    printdii_info(FCT("sfs_batch") "putc run of %d chars to fd %d", len, fd);
+    CHK_FD(fd, caller_id)
+    CHK_PERM(fd_cache[fd]->flags, SFS_WRITE);
+
+    int i;
+    for (i = 0; i < len; i++)
+    {
+        buf = from[i];
+        if (cfs_write(fd, &buf, 1) <= 0)
+            break;
+    }
+    return i;
+}
+
+int SM_ENTRY("sfs") sfs_batch(struct sfs_op *ops, int nb_ops)
+{
+    sm_id caller_id = sancus_get_caller_id();
+    DO_INIT()
+    printdi_info(FCT("sfs_batch") "executing batch of %d operations", nb_ops);
+
+    if (nb_ops < 0 || nb_ops > SFS_MAX_BATCH_OPS ||
+        !sancus_is_outside_sm(sfs, ops, nb_ops * sizeof(struct sfs_op)))
+    {
+        printerror_int("invalid batch of %d operations", nb_ops);
+        COUNT_FAIL(SFS_FAIL_INVALID)
+        return FAILURE;
+    }
+
+    // protected copy of the current operation, immune to third party changes
+    struct sfs_op op;
+    int i, rv, last_fd = FAILURE;
+    for (i = 0; i < nb_ops; i++)
+    {
+        op = ops[i];
+        if (op.fd == SFS_BATCH_LAST_FD)
+            op.fd = last_fd;
+        
+        // every operation is counted (and profiled) as the entry it stands for
+        switch (op.op)
+        {
+            case SFS_OP_OPEN:
+            {
+                ENTER_OP(SFS_STAT_OPEN)
+                rv = TRACE(SFS_STAT_OPEN, caller_id, op.name, 0, op.arg1, op.arg2,
+                    do_open(caller_id, op.name, op.arg1, op.arg2));
+                if (rv >= 0)
+                    last_fd = rv;
+                break;
+            }
+            case SFS_OP_CLOSE:
+            {
+                ENTER_OP(SFS_STAT_CLOSE)
+                rv = TRACE(SFS_STAT_CLOSE, caller_id, 0, op.fd, 0, 0,
+                    do_close(caller_id, op.fd));
+                break;
+            }
+            case SFS_OP_SEEK:
+            {
+                ENTER_OP(SFS_STAT_SEEK)
+                rv = TRACE(SFS_STAT_SEEK, caller_id, 0, op.fd, op.arg1, op.arg2,
+                    do_seek(caller_id, op.fd, op.arg1, op.arg2));
+                break;
+            }
+            case SFS_OP_GETC_RUN:
+            case SFS_OP_PUTC_RUN:
+            {
+                int stat_op = (op.op == SFS_OP_GETC_RUN) ? SFS_STAT_GETC : SFS_STAT_PUTC;
+                ENTER_OP(stat_op)
+                if (op.arg1 < 0 || !sancus_is_outside_sm(sfs, op.buf, op.arg1))
+                {
+                    printerror_int("invalid buffer for batched op %d", i);
+                    COUNT_FAIL(SFS_FAIL_INVALID)
+                    rv = FAILURE;
+                }
+                else if (op.op == SFS_OP_GETC_RUN)
+                    rv = TRACE(SFS_TRACE_GETC_RUN, caller_id, 0, op.fd, op.arg1, 0,
+                        do_getc_run(caller_id, op.fd, op.buf, op.arg1));
+                else
+                    rv = TRACE(SFS_TRACE_PUTC_RUN, caller_id, 0, op.fd, op.arg1, 0,
+                        do_putc_run(caller_id, op.fd, op.buf, op.arg1));
+                // a run counts as one call per char moved (and at least one)
+                if (rv > 1)
+                    op_count[stat_op] += rv - 1;
+                break;
+            }
+            case SFS_OP_CHMOD:
+            {
+                ENTER_OP(SFS_STAT_CHMOD)
+                rv = TRACE(SFS_STAT_CHMOD, caller_id, op.name, 0, op.arg1, op.arg2,
+                    do_chmod(caller_id, op.name, op.arg1, op.arg2));
+                break;
+            }
+            default:
+                printerror_int("unknown batched operation code %d", op.op);
+                COUNT_FAIL(SFS_FAIL_INVALID)
+                rv = FAILURE;
+        }
+        ops[i].rv = rv;
+    }
+
+    return nb_ops;
+}
+
+// ######################### SEALED BULK TRANSFERS ################################
+
+#define CHK_OUTSIDE_SFS(ptr, len) \
+    if (!sancus_is_outside_sm(sfs, ptr, len)) \
+    { \
+        printerror("provided buffer overlaps with the SFS module"); \
+        COUNT_FAIL(SFS_FAIL_INVALID) \
+        return FAILURE; \
+    }
+
+// a sealed transfer needs every key word set, and a sequence number that has
+// not been used under this key before (i.e. that did not wrap)
+#define CHK_SEALED_KEY(fd) \
+    if (sealed_key_set[fd] != SEALED_KEY_COMPLETE || sealed_seq[fd] == UINT_MAX) \
+    { \
+        printerror("incomplete or exhausted session key; set the key first"); \
+        COUNT_FAIL(SFS_FAIL_INVALID) \
+        return FAILURE; \
+    }
+
+#define FILL_SEALED_AD(the_ad, the_caller, the_fd, the_len) \
+do { \
+    the_ad.caller_id = the_caller; \
+    the_ad.fd = the_fd; \
+    the_ad.session = sealed_session[the_fd]; \
+    the_ad.seq = sealed_seq[the_fd]; \
+    the_ad.len = the_len; \
+} while(0)
+
+int SM_ENTRY("sfs") sfs_set_key(int fd, int idx, unsigned int word)
+{
+    sm_id caller_id = sancus_get_caller_id();
+    DO_INIT()
+    printdii_info(FCT("sfs_set_key") "setting key word %d for fd %d", idx, fd);
+
+    CHK_FD(fd, caller_id)
+    if (idx < 0 || idx >= SEALED_KEY_WORDS)
+    {
+        printerror_int("key word index %d out of range", idx);
+        COUNT_FAIL(SFS_FAIL_INVALID)
+        return FAILURE;
+    }
+
+    // the session numbers are returned as a positive int, and never reused
+    if (sealed_last_session == INT_MAX)
+    {
+        printerror("no session numbers left; refusing a new key");
+        COUNT_FAIL(SFS_FAIL_INVALID)
+        return FAILURE;
+    }
+
+    // a word set after a complete key starts a new key, and a new session
+    if (sealed_key_set[fd] == SEALED_KEY_COMPLETE)
+        CLEAR_SEALED_KEY(fd);
+    sealed_key[fd][2 * idx] = word & 0xff;
+    sealed_key[fd][2 * idx + 1] = word >> 8;
+    sealed_key_set[fd] |= 1U << idx;
+    if (sealed_key_set[fd] != SEALED_KEY_COMPLETE)
+        return SUCCESS;
+
+    sealed_session[fd] = ++sealed_last_session;
+    sealed_seq[fd] = 0;
+    return sealed_session[fd];
+}
+
+int SM_ENTRY("sfs") sfs_read_sealed(int fd, unsigned char *cipher,
+    unsigned int len, unsigned char *tag)
+{
+    sm_id caller_id = sancus_get_caller_id();
+    DO_INIT()
+    printdii_info(FCT("sfs_read_sealed") "sealed read of %d bytes from fd %d", len, fd);
+
+    CHK_FD(fd, caller_id)
+    CHK_PERM(fd_cache[fd]->flags, SFS_READ);
+    CHK_SEALED_KEY(fd)
+    if (len > SFS_SEALED_MAX_LEN)
+        len = SFS_SEALED_MAX_LEN;
+    CHK_OUTSIDE_SFS(cipher, len)
+    CHK_OUTSIDE_SFS(tag, SANCUS_TAG_SIZE)
+
+    // first read the plain text into protected memory
+    unsigned int n = 0; int rv;
+    TSC1()
+    while (n < len && (rv = cfs_read(fd, sealed_buf + n, len - n)) > 0)
+        n += rv;
+    TSC2("cfs_read_sealed")
+
+    // like sfs_getc(): nothing read is EOF; the sequence number is not used up
+    if (n == 0 && len > 0)
+        return EOF;
+
+    struct sfs_sealed_ad ad;
+    FILL_SEALED_AD(ad, caller_id, fd, n);
+    if (!sancus_wrap_with_key(sealed_key[fd], &ad, sizeof(ad), sealed_buf, n,
+        cipher, tag))
+    {
+        printerror("sancus_wrap failed");
+        COUNT_FAIL(SFS_FAIL_INVALID)
+        return FAILURE;
+    }
+    sealed_seq[fd]++;
+
+    return n;
+}
+
+int SM_ENTRY("sfs") sfs_write_sealed(int fd, unsigned char *cipher,
+    unsigned int len, unsigned char *tag)
+{
+    sm_id caller_id = sancus_get_caller_id();
+    DO_INIT()
+    printdii_info(FCT("sfs_write_sealed") "sealed write of %d bytes to fd %d", len, fd);
+
+    CHK_FD(fd, caller_id)
+    CHK_PERM(fd_cache[fd]->flags, SFS_WRITE);
+    CHK_SEALED_KEY(fd)
+    if (len > SFS_SEALED_MAX_LEN)
+    {
+        printerror_int("sealed write of %d bytes too large", len);
+        COUNT_FAIL(SFS_FAIL_INVALID)
+        return FAILURE;
+    }
+    CHK_OUTSIDE_SFS(cipher, len)
+    CHK_OUTSIDE_SFS(tag, SANCUS_TAG_SIZE)
+
+    // copy the cipher text and tag first, so they cannot change after verification
+    unsigned int n;
+    for (n = 0; n < len; n++)
+        sealed_buf[n] = cipher[n];
+    for (n = 0; n < SANCUS_TAG_SIZE; n++)
+        sealed_tag[n] = tag[n];
+
+    struct sfs_sealed_ad ad;
+    FILL_SEALED_AD(ad, caller_id, fd, len);
+    if (!sancus_unwrap_with_key(sealed_key[fd], &ad, sizeof(ad), sealed_buf, len,
+        sealed_tag, sealed_buf))
+    {
+        printerror("sancus_unwrap failed; rejecting sealed write");
+        COUNT_FAIL(SFS_FAIL_INVALID)
+        return FAILURE;
+    }
+    sealed_seq[fd]++;
+
+    int rv = 0;
+    TSC1()
+    for (n = 0; n < len && (rv = cfs_write(fd, sealed_buf + n, len - n)) > 0; n += rv)
+        ;
+    TSC2("cfs_write_sealed")
+
+    return (n > 0 || len == 0)? (int) n : EOF;
+}
+
+// ############################### STATISTICS #####################################
+
+#define COPY_CFS_USAGE(the_pool, resource) \
+do { \
+    struct cfs_usage usage; \
+    cfs_usage(resource, &usage, reset); \
+    stats->pool[the_pool].cur = usage.cur; \
+    stats->pool[the_pool].max = usage.max; \
+    stats->pool[the_pool].size = usage.size; \
+} while(0)
+
+int SM_ENTRY("sfs") sfs_stats(struct sfs_stats *stats, int reset)
+{
+    sm_id caller_id = sancus_get_caller_id();
+    DO_INIT()
+#ifdef SFS_STATS_OWNER
+    if (reset && caller_id != SFS_STATS_OWNER)
+#else
+    if (reset)
+#endif
+    {
+        printerror_int("caller %d may not reset the statistics", caller_id);
+        COUNT_FAIL(SFS_FAIL_PERM)
+        return FAILURE;
+    }
+    CHK_OUTSIDE_SFS(stats, sizeof(struct sfs_stats))
+
+    int i, j;
+    for (i = 0; i < SFS_NB_STAT_OPS; i++)
+    {
+        stats->calls[i] = op_count[i];
+        for (j = 0; j < SFS_NB_LAYERS; j++)
+        {
+#ifdef SFS_PROFILE
+            stats->layer[i][j] = sfs_prof_layers[i][j];
+            if (reset)
+                sfs_prof_layers[i][j].incl = sfs_prof_layers[i][j].excl = 0;
+#else
+            stats->layer[i][j].incl = stats->layer[i][j].excl = 0;
+#endif
+        }
+        if (reset)
+            op_count[i] = 0;
+    }
+
+    for (i = 0; i < SFS_NB_FAIL_CAUSES; i++)
+    {
+        stats->failures[i] = fail_count[i];
+        if (reset)
+            fail_count[i] = 0;
+    }
+
+    stats->pool[SFS_POOL_FILES].size = MAX_NB_FILES;
+    stats->pool[SFS_POOL_PERMS].size = MAX_NB_PERMS;
+    stats->pool[SFS_POOL_FDS].size = MAX_NB_OPEN_FILES;
+    for (i = SFS_POOL_FILES; i <= SFS_POOL_FDS; i++)
+    {
+        stats->pool[i].cur = pool_used[i];
+        stats->pool[i].max = pool_max[i];
+        if (reset)
+            pool_max[i] = pool_used[i];
+    }
+    COPY_CFS_USAGE(SFS_POOL_CFS_FILES, CFS_USAGE_FILES);
+    COPY_CFS_USAGE(SFS_POOL_CFS_FDS, CFS_USAGE_FDS);
+
+    return SUCCESS;
+}
+
+// ############################### TRACING ########################################
+
+int SM_ENTRY("sfs") sfs_trace(struct sfs_trace_rec *recs, int max_recs)
+{
+#ifdef SFS_TRACE
+    sm_id caller_id = sancus_get_caller_id();
+    DO_INIT()
+    if (caller_id != SFS_TRACE_READER)
+    {
+        printerror("only the trace reader may retrieve the trace");
+        COUNT_FAIL(SFS_FAIL_PERM)
+        return FAILURE;
+    }
+
+    // at most the lost record and a full ring; also keeps the size below from
+    // wrapping around a 16-bit size_t
+    if (max_recs < 0)
+        max_recs = 0;
+    if (max_recs > SFS_TRACE_SIZE + 1)
+        max_recs = SFS_TRACE_SIZE + 1;
+    CHK_OUTSIDE_SFS(recs, max_recs * sizeof(struct sfs_trace_rec))
+
+    int n = 0;
+    if (trace_lost && max_recs > 0)
+    {
+        recs[n].op = SFS_TRACE_LOST;
+        recs[n].name = recs[n].caller_id = 0;
+        recs[n].fd = recs[n].arg1 = recs[n].arg2 = 0;
+        recs[n].rv = trace_lost;
+        trace_lost = 0;
+        n++;
+    }
+    for (; n < max_recs && trace_len; n++, trace_len--)
+    {
+        recs[n] = trace_ring[trace_head];
+        trace_head = (trace_head + 1) & (SFS_TRACE_SIZE - 1);
+    }
+    return n;
+#else
+    return 0;
+#endif
+}
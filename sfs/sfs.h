@@ -135,6 +135,247 @@ typedef char filename_t;
 #define SFS_SEEK_END 2
 #endif
 
+/**
+ * Operation codes for a struct sfs_op in a batch submitted through sfs_batch().
+ *
+ * SFS_OP_OPEN      sfs_open(name, arg1, arg2)
+ * SFS_OP_CLOSE     sfs_close(fd)
+ * SFS_OP_SEEK      sfs_seek(fd, arg1, arg2)
+ * SFS_OP_GETC_RUN  up to arg1 times sfs_getc(fd) into buf; stops at EOF
+ * SFS_OP_PUTC_RUN  arg1 times sfs_putc(fd, buf[i]); stops at the first failure
+ * SFS_OP_CHMOD     sfs_chmod(name, arg1, arg2)
+ *
+ * \sa sfs_batch()
+ */
+#define SFS_OP_OPEN         1
+#define SFS_OP_CLOSE        2
+#define SFS_OP_SEEK         3
+#define SFS_OP_GETC_RUN     4
+#define SFS_OP_PUTC_RUN     5
+#define SFS_OP_CHMOD        6
+
+/**
+ * The maximum number of operations in a single sfs_batch() call.
+ */
+#define SFS_MAX_BATCH_OPS   16
+
+/**
+ * When used as the fd of a batched operation, refers to the file descriptor
+ * returned by the most recent successful SFS_OP_OPEN in the same batch.
+ */
+#define SFS_BATCH_LAST_FD   -2
+
+/**
+ * A single operation of a batch; to be placed in unprotected memory.
+ *
+ * \note the SFS module copies every operation into protected memory before
+ * executing it, so later modifications by a third party have no effect.
+ * Data transfered through buf is however not confidential; use sfs_getc() and
+ * sfs_putc() for confidential data.
+ *
+ * \sa sfs_batch()
+ */
+struct sfs_op {
+    int op;                 // one of the SFS_OP_* codes above
+    int fd;                 // file descriptor, or SFS_BATCH_LAST_FD
+    filename_t name;        // SFS_OP_OPEN, SFS_OP_CHMOD
+    int arg1;               // operation specific, see SFS_OP_* codes above
+    int arg2;               // operation specific, see SFS_OP_* codes above
+    unsigned char *buf;     // unprotected data buffer for the SFS_OP_*_RUN ops
+    int rv;                 // the operation's return value, filled in by SFS
+};
+
+/**
+ * The maximum number of bytes moved by a single sealed bulk transfer.
+ *
+ * \sa sfs_read_sealed(), sfs_write_sealed()
+ */
+#define SFS_SEALED_MAX_LEN  64
+
+/**
+ * The associated data authenticated with every sealed bulk transfer. The
+ * client SM fills in the same values (its own id, the fd, the session number
+ * returned by sfs_set_key(), the number of sealed transfers in this session
+ * and the byte count) to unwrap/wrap the data with the session key.
+ *
+ * \sa sfs_set_key(), sfs_read_sealed(), sfs_write_sealed()
+ */
+struct sfs_sealed_ad {
+    sm_id caller_id;
+    int fd;
+    unsigned int session;
+    unsigned int seq;
+    unsigned int len;
+};
+
+/**
+ * The layers an SFS call passes through, for the per-layer cycle breakdown
+ * collected by an SFS_PROFILE build (see sfs-prof.h).
+ *
+ * SFS_LAYER_SFS    front-end: access control and bookkeeping in the SFS module
+ * SFS_LAYER_CFS    CFS back-end: e.g. Coffee file data handling, shm copies
+ * SFS_LAYER_META   Coffee metadata: file headers, file lookup, page allocation
+ *                  and garbage collection
+ * SFS_LAYER_FLASH  flash driver: SPI transfers and busy waiting
+ *
+ * \sa sfs_stats()
+ */
+#define SFS_LAYER_SFS       0
+#define SFS_LAYER_CFS       1
+#define SFS_LAYER_META      2
+#define SFS_LAYER_FLASH     3
+#define SFS_NB_LAYERS       4
+
+/**
+ * The paths of an SFS call whose cost is not bounded by the fixed size pools
+ * nor by its arguments, but by the flash or heap state the back-end built up;
+ * an SFS_WCET build flags the paths every call takes (see sfs-prof.h).
+ *
+ * SFS_PATH_FLASH_SCAN  Coffee: walking the file headers or data on flash, to
+ *                      find a file, its end or free pages
+ * SFS_PATH_GC          Coffee: garbage collection, inspecting every sector and
+ *                      erasing the obsolete ones
+ * SFS_PATH_MERGE_LOG   Coffee: merging a full micro log or extending a file,
+ *                      copying the whole file to a new extent
+ * SFS_PATH_COMPACT     shm: compacting the my_malloc arenas, moving every file
+ * SFS_PATH_MOVE        shm: growing a file by moving it to a new block
+ */
+#define SFS_PATH_FLASH_SCAN 0x01
+#define SFS_PATH_GC         0x02
+#define SFS_PATH_MERGE_LOG  0x04
+#define SFS_PATH_COMPACT    0x08
+#define SFS_PATH_MOVE       0x10
+#define SFS_NB_PATHS        5
+
+/**
+ * The entry calls sfs_stats() reports on, as indices in struct sfs_stats.
+ *
+ * \sa sfs_stats()
+ */
+#define SFS_STAT_OPEN       0
+#define SFS_STAT_CLOSE      1
+#define SFS_STAT_GETC       2
+#define SFS_STAT_PUTC       3
+#define SFS_STAT_SEEK       4
+#define SFS_STAT_PREAD      5
+#define SFS_STAT_PWRITE     6
+#define SFS_STAT_CHMOD      7
+#define SFS_STAT_REMOVE     8
+#define SFS_NB_STAT_OPS     9
+
+/**
+ * The causes of failing SFS calls, as indices in struct sfs_stats.
+ *
+ * SFS_FAIL_BAD_FD   invalid file descriptor, or one of another SM
+ * SFS_FAIL_PERM     permission denied, or no ACL entry for the caller
+ * SFS_FAIL_POOL     no free OPEN_FILE or FILE_PERM struct, or fd_cache entry
+ * SFS_FAIL_NO_FILE  the file does not exist
+ * SFS_FAIL_BUSY     the file is still open
+ * SFS_FAIL_BACKEND  the CFS back-end failed
+ * SFS_FAIL_INVALID  other invalid arguments, e.g. buffers overlapping the SFS
+ */
+#define SFS_FAIL_BAD_FD     0
+#define SFS_FAIL_PERM       1
+#define SFS_FAIL_POOL       2
+#define SFS_FAIL_NO_FILE    3
+#define SFS_FAIL_BUSY       4
+#define SFS_FAIL_BACKEND    5
+#define SFS_FAIL_INVALID    6
+#define SFS_NB_FAIL_CAUSES  7
+
+/**
+ * The fixed size pools sfs_stats() reports the usage of.
+ *
+ * SFS_POOL_FILES      file_pool: one OPEN_FILE struct per file
+ * SFS_POOL_PERMS      perm_pool: one FILE_PERM struct per ACL entry
+ * SFS_POOL_FDS        fd_cache: one entry per open file descriptor
+ * SFS_POOL_CFS_FILES  the back-end's file structures (e.g. Coffee's file cache)
+ * SFS_POOL_CFS_FDS    the back-end's file descriptors
+ */
+#define SFS_POOL_FILES      0
+#define SFS_POOL_PERMS      1
+#define SFS_POOL_FDS        2
+#define SFS_POOL_CFS_FILES  3
+#define SFS_POOL_CFS_FDS    4
+#define SFS_NB_POOLS        5
+
+/**
+ * The current (cur) and high-water (max) number of used entries of a pool of
+ * size entries.
+ */
+struct sfs_pool_stats {
+    unsigned int cur;
+    unsigned int max;
+    unsigned int size;
+};
+
+/**
+ * The cycles spent in a layer, including (incl) and excluding (excl) the time
+ * spent in the layers below it.
+ */
+struct sfs_layer_stats {
+    unsigned long incl;
+    unsigned long excl;
+};
+
+/**
+ * Statistics filled in by sfs_stats(); to be placed in unprotected memory.
+ *
+ * \sa sfs_stats()
+ */
+struct sfs_stats {
+    unsigned long calls[SFS_NB_STAT_OPS];
+    unsigned long failures[SFS_NB_FAIL_CAUSES];
+    struct sfs_pool_stats pool[SFS_NB_POOLS];
+    struct sfs_layer_stats layer[SFS_NB_STAT_OPS][SFS_NB_LAYERS];
+};
+
+/**
+ * The operation codes of a struct sfs_trace_rec that are no SFS_STAT_* entry.
+ *
+ * SFS_TRACE_GETC_RUN  an SFS_OP_GETC_RUN of an sfs_batch()
+ * SFS_TRACE_PUTC_RUN  an SFS_OP_PUTC_RUN of an sfs_batch()
+ * SFS_TRACE_LOST      not a call: rv calls were overwritten in the trace ring
+ *                     before they were retrieved
+ */
+#define SFS_TRACE_GETC_RUN  SFS_NB_STAT_OPS
+#define SFS_TRACE_PUTC_RUN  (SFS_NB_STAT_OPS + 1)
+#define SFS_TRACE_LOST      0xFF
+
+/**
+ * A single SFS call recorded by an SFS_TRACE build; to be placed in unprotected
+ * memory. The arguments of every op are
+ *
+ * SFS_STAT_OPEN       name, arg1 = flags, arg2 = size
+ * SFS_STAT_CLOSE      fd
+ * SFS_STAT_GETC       fd
+ * SFS_STAT_PUTC       fd
+ * SFS_STAT_SEEK       fd, arg1 = offset, arg2 = whence
+ * SFS_STAT_PREAD      fd, arg1 = offset
+ * SFS_STAT_PWRITE     fd, arg1 = offset
+ * SFS_STAT_CHMOD      name, arg1 = id, arg2 = perm_flags
+ * SFS_STAT_REMOVE     name
+ * SFS_TRACE_*_RUN     fd, arg1 = len
+ *
+ * and the unused fields are zero. Operations of an sfs_batch() are recorded
+ * one by one, with the fd an SFS_BATCH_LAST_FD resolved to.
+ *
+ * The rv of SFS_STAT_GETC, _PUTC, _PREAD and _PWRITE is 0 when the call
+ * succeeded, or the negative value it returned: the byte read or written is
+ * never recorded, such that the trace only reveals the access pattern.
+ *
+ * \sa sfs_trace()
+ */
+struct sfs_trace_rec {
+    unsigned char op;       // SFS_STAT_* or SFS_TRACE_* code
+    filename_t name;
+    sm_id caller_id;
+    int fd;
+    int arg1;
+    int arg2;
+    int rv;                 // the call's return value
+};
+
 // ######################## SFS API ##########################
 
 /**
@@ -251,6 +492,43 @@ int SM_ENTRY("sfs") sfs_putc(int fd, unsigned char c);
  */
 int SM_ENTRY("sfs") sfs_seek(int fd, int offset, int whence);
 
+/**
+ * [NEW FUNCTION]
+ * \brief        Read a single byte at a given position of an open file.
+ * \param fd     The file descriptor of the open file.
+ * \param offset The absolute position in the file to read from.
+ * \return       The read character (converted to an unsigned int);
+ *               else EOF if the request could not be satisfied.
+ *
+ *               Equivalent to sfs_seek(fd, offset, SFS_SEEK_SET) followed by
+ *               sfs_getc(fd), but performed in a single SM crossing. The
+ *               file position is left after the read byte. On failure
+ *               (including a failed permission check) the file position is
+ *               left unchanged.
+ *
+ * \sa          sfs_getc(), sfs_seek()
+ */
+int SM_ENTRY("sfs") sfs_pread(int fd, int offset);
+
+/**
+ * [NEW FUNCTION]
+ * \brief        Write a single byte at a given position of an open file.
+ * \param fd     The file descriptor of the open file.
+ * \param offset The absolute position in the file to write to.
+ * \param c      The char to write into the file.
+ * \return       The character written (converted to an unsigned int)
+ *               else EOF if the request could not be satisfied.
+ *
+ *               Equivalent to sfs_seek(fd, offset, SFS_SEEK_SET) followed by
+ *               sfs_putc(fd, c), but performed in a single SM crossing. The
+ *               file position is left after the written byte. On failure
+ *               (including a failed permission check) the file position is
+ *               left unchanged.
+ *
+ * \sa          sfs_putc(), sfs_seek()
+ */
+int SM_ENTRY("sfs") sfs_pwrite(int fd, int offset, unsigned char c);
+
 /**
  * [MODIFIED SEMANTICS]
  * \brief      Remove a file.
@@ -298,4 +576,133 @@ int SM_ENTRY("sfs") sfs_chmod(filename_t name, sm_id id, int perm_flags);
  */
 int SM_ENTRY("sfs") sfs_attest(filename_t name, sm_id owner);
 
+/**
+ * [NEW FUNCTION]
+ * \brief        Execute a batch of operations in a single SM crossing.
+ * \param ops    Pointer to an array of operations in unprotected memory.
+ * \param nb_ops The number of operations in the array (at most
+ *               SFS_MAX_BATCH_OPS).
+ * \return       The number of executed operations; or -1 if the batch
+ *               was rejected as a whole.
+ *
+ *               The caller identity is retrieved once for the whole batch.
+ *               The operations are executed in order, each with the semantics
+ *               of the corresponding single SFS call; the return value of
+ *               every operation is stored in its rv field. A failing
+ *               operation does not abort the batch.
+ *
+ *               The batch is rejected if @p(ops), or the buf of a run
+ *               operation, does not lie entirely outside the SFS module.
+ *
+ * \sa          struct sfs_op
+ */
+int SM_ENTRY("sfs") sfs_batch(struct sfs_op *ops, int nb_ops);
+
+/**
+ * [NEW FUNCTION]
+ * \brief       Set one word of the session key for sealed bulk transfers.
+ * \param fd    The file descriptor of the open file.
+ * \param idx   The index of the 16-bit key word to set (0 to
+ *              SANCUS_KEY_SIZE/2 - 1).
+ * \param word  The key word (little endian).
+ * \return      The session number (> 0) when this word completes the key; a
+ *              value >= 0 for the other words; a negative value on failure.
+ *
+ *              The key is transfered safely through CPU registers, one word
+ *              per call, and is bound to the file descriptor: it is wiped when
+ *              the fd is closed. Sealed transfers are refused until every key
+ *              word has been set. A word set after the key is complete starts
+ *              a new key. Each completed key gets a new session number, never
+ *              reused (not even by another fd or after a reopen), and its
+ *              sequence number of sealed transfers starts at zero; both are
+ *              bound in the associated data, so setting the same key again
+ *              never repeats it. Sealed transfers are refused again when the
+ *              sequence number would wrap, until a new key is set; new keys are
+ *              refused once the session numbers run out (at INT_MAX).
+ *
+ * \sa          sfs_read_sealed(), sfs_write_sealed()
+ */
+int SM_ENTRY("sfs") sfs_set_key(int fd, int idx, unsigned int word);
+
+/**
+ * [NEW FUNCTION]
+ * \brief        Read a block from an open file, sealed with the session key.
+ * \param fd     The file descriptor of the open file.
+ * \param cipher Unprotected buffer that receives the encrypted data.
+ * \param len    The number of bytes to read (at most SFS_SEALED_MAX_LEN).
+ * \param tag    Unprotected buffer that receives the SANCUS_TAG_SIZE tag.
+ * \return       The number of bytes read and sealed; EOF when nothing could be
+ *               read (e.g. at the end of the file); else a negative value.
+ *
+ *               The caller must have SFS_READ permission on the open file. The
+ *               data is encrypted and authenticated by the Sancus hardware
+ *               with the session key and a struct sfs_sealed_ad as associated
+ *               data, so it can safely pass through unprotected memory. The
+ *               caller unwraps it inside its own module.
+ */
+int SM_ENTRY("sfs") sfs_read_sealed(int fd, unsigned char *cipher,
+    unsigned int len, unsigned char *tag);
+
+/**
+ * [NEW FUNCTION]
+ * \brief        Write a block, sealed with the session key, to an open file.
+ * \param fd     The file descriptor of the open file.
+ * \param cipher Unprotected buffer holding the encrypted data.
+ * \param len    The number of bytes to write (at most SFS_SEALED_MAX_LEN).
+ * \param tag    Unprotected buffer holding the SANCUS_TAG_SIZE tag.
+ * \return       The number of bytes written; else EOF.
+ *
+ *               The caller must have SFS_WRITE permission on the open file.
+ *               Nothing is written when the data cannot be authenticated with
+ *               the session key and the expected struct sfs_sealed_ad.
+ */
+int SM_ENTRY("sfs") sfs_write_sealed(int fd, unsigned char *cipher,
+    unsigned int len, unsigned char *tag);
+
+/**
+ * [NEW FUNCTION]
+ * \brief        Retrieve the statistics of the SFS module.
+ * \param stats  Unprotected buffer that receives the statistics.
+ * \param reset  Non-zero to restart all statistics from zero afterwards.
+ * \return       A value >= 0 on success; -1 if @p(stats) does not lie entirely
+ *               outside the SFS module, or if the caller may not reset.
+ *
+ *               Always reports the number of calls of every SFS_STAT_* entry,
+ *               the number of failed SFS calls by SFS_FAIL_* cause and the usage
+ *               of every SFS_POOL_*; high-water marks restart from the current
+ *               usage on reset. An SFS_PROFILE build (of the front-end, back-end
+ *               and flash driver) also reports the inclusive and exclusive
+ *               cycles every entry spent in every SFS_LAYER_*; otherwise these
+ *               are zero.
+ *
+ *               The operations of an sfs_batch() are counted under the entry
+ *               they stand for; a getc or putc run counts as one call per char
+ *               moved. Only the module with id SFS_STATS_OWNER, fixed at build
+ *               time (0 for unprotected code), may reset the statistics; without
+ *               an owner they are read-only.
+ */
+int SM_ENTRY("sfs") sfs_stats(struct sfs_stats *stats, int reset);
+
+/**
+ * [NEW FUNCTION]
+ * \brief          Retrieve the calls recorded in the trace ring of the SFS module.
+ * \param recs     Unprotected buffer that receives the records.
+ * \param max_recs The number of records that fit in @p(recs).
+ * \return         The number of records retrieved; -1 if the caller is not the
+ *                 trace reader or if @p(recs) does not lie entirely outside the
+ *                 SFS module.
+ *
+ *                 An SFS_TRACE build records every SFS entry call in a ring of
+ *                 SFS_TRACE_SIZE records. The retrieved records are removed from
+ *                 the ring, oldest first; when calls were overwritten since the
+ *                 previous retrieval, the first record is an SFS_TRACE_LOST
+ *                 record. Other builds record nothing and always return 0.
+ *
+ *                 Only the module with id SFS_TRACE_READER, fixed at build
+ *                 time (0 for unprotected code), may retrieve the trace.
+ *
+ * \sa             struct sfs_trace_rec
+ */
+int SM_ENTRY("sfs") sfs_trace(struct sfs_trace_rec *recs, int max_recs);
+
 #endif /* SFS_H_ */
@@ -9,7 +9,54 @@
 #include "../cfs/cfs.h"     // SM_F an SM_D macros to enable/disable back-end protection
 
 /*
- * Returns a pointer in the protected mem buf, to a free chunk of the requested size;
+ * Build-time arena configuration. The first-fit allocator manages MALLOC_NB_ARENAS
+ *  arenas of MALLOC_BUF_SIZE bytes each (an allocation never spans two arenas);
+ *  the segregated-fit allocator (SHM_SEG_MALLOC) has its own buf of
+ *  MALLOC_SEG_BUF_SIZE bytes.
+ */
+#ifndef MALLOC_BUF_SIZE
+    #define MALLOC_BUF_SIZE         1000
+#endif
+#ifndef MALLOC_NB_ARENAS
+    #define MALLOC_NB_ARENAS        1
+#endif
+// the alignment of the returned blocks: a 16-bit word (2) or 4 bytes
+#ifndef MALLOC_ALIGN
+    #define MALLOC_ALIGN            2
+#endif
+#ifndef MALLOC_SEG_BUF_SIZE
+    #define MALLOC_SEG_BUF_SIZE     MALLOC_BUF_SIZE
+#endif
+// the seg buf only takes SM data when the allocator is compiled in
+#ifdef SHM_SEG_MALLOC
+    #define MALLOC_SEG_BUDGET       MALLOC_SEG_BUF_SIZE
+#else
+    #define MALLOC_SEG_BUDGET       0
+#endif
+// device has 10 KB (10240B) data memory; leave 2 KB for the stacks and the
+// data of the other modules
+#ifndef MALLOC_DATA_BUDGET
+    #define MALLOC_DATA_BUDGET      8192
+#endif
+
+#if MALLOC_ALIGN != 2 && MALLOC_ALIGN != 4
+    #error "MALLOC_ALIGN must be 2 or 4"
+#endif
+#if MALLOC_BUF_SIZE % MALLOC_ALIGN
+    #error "MALLOC_BUF_SIZE must be a multiple of MALLOC_ALIGN, to keep all arenas aligned"
+#endif
+#if MALLOC_BUF_SIZE < 64
+    #error "MALLOC_BUF_SIZE too small to hold the boundary tags and a free chunk"
+#endif
+#if MALLOC_NB_ARENAS < 1
+    #error "MALLOC_NB_ARENAS must be at least 1"
+#endif
+#if MALLOC_NB_ARENAS * MALLOC_BUF_SIZE + MALLOC_SEG_BUDGET > MALLOC_DATA_BUDGET
+    #error "the malloc bufs exceed the SM data budget (MALLOC_DATA_BUDGET)"
+#endif
+
+/*
+ * Returns a MALLOC_ALIGN aligned pointer in the protected mem buf, to a free chunk of the requested size;
  *  or NULL iff no free chunk of sufficient size found
  */
 void SM_F("sfs") *my_malloc(size_t size);
@@ -26,9 +73,85 @@ void SM_F("sfs") init_free_list(void);
  */
 void SM_F("sfs") my_free(void *ptr);
 
+/*
+ * Resizes the allocation at @param(ptr) to at least @param(size) bytes, in place
+ *  iff the following chunk is free and large enough; else the data is moved.
+ *  Returns the new pointer, or NULL iff no space left (ptr is then untouched).
+ */
+void SM_F("sfs") *my_realloc(void *ptr, size_t size);
+
+/*
+ * Returns the number of usable bytes in the allocation at @param(ptr).
+ */
+size_t SM_F("sfs") my_malloc_size(void *ptr);
+
+/*
+ * Called by my_compact() for every moved allocation.
+ */
+typedef void (*malloc_relocate_t)(void *old_ptr, void *new_ptr);
+
+/*
+ * Slides all allocations to the start of the buf, leaving a single free chunk;
+ *  calls @param(relocate) for every moved allocation, so the owner can update
+ *  its pointers. Returns the number of moved allocations.
+ */
+unsigned int SM_F("sfs") my_compact(malloc_relocate_t relocate);
+
+/*
+ * Free space statistics of the my_malloc buffer.
+ */
+struct malloc_stats {
+    size_t free_bytes;          // total payload bytes in free chunks
+    size_t largest_free;        // payload bytes of the largest free chunk
+    unsigned int nb_free_chunks;
+};
+
+/*
+ * The external fragmentation in percent: the share of the free bytes that
+ *  cannot be served by a single allocation (0 when all free space is contiguous).
+ */
+#define MALLOC_FRAGMENTATION(stats) \
+    ((stats).free_bytes ? \
+        (unsigned int) (100 - (100UL * (stats).largest_free) / (stats).free_bytes) : 0)
+
+/*
+ * Fills in @param(stats) with the current free space statistics of my_malloc.
+ */
+void SM_F("sfs") my_malloc_stats(struct malloc_stats *stats);
+
 /*
  * Prints the current linked list of free chunks on stdout, iff DEBUG. Used for debugging.
  */
 void SM_F("sfs") print_free_list(void);
 
+#ifdef SHM_SEG_MALLOC
+/*
+ * Segregated-fit alternative to my_malloc(): power-of-two size classes with a
+ *  free list per class, for constant time allocation. Returns NULL iff no block
+ *  of sufficient size is available.
+ */
+void SM_F("sfs") *seg_malloc(size_t size);
+
+/*
+ * Initialises the size class free lists used by seg_malloc.
+ */
+void SM_F("sfs") init_seg_lists(void);
+
+/*
+ * Frees the memory pointed to by @param(ptr), obtained by seg_malloc().
+ */
+void SM_F("sfs") seg_free(void *ptr);
+
+/*
+ * Resizes the block at @param(ptr), obtained by seg_malloc(); moves the data
+ *  iff the request exceeds its size class. Returns NULL iff no space left.
+ */
+void SM_F("sfs") *seg_realloc(void *ptr, size_t size);
+
+/*
+ * Returns the number of usable bytes in the block at @param(ptr).
+ */
+size_t SM_F("sfs") seg_malloc_size(void *ptr);
+#endif // SHM_SEG_MALLOC
+
 #endif //my_malloc.h
@@ -6,6 +6,8 @@
 #include "../sfs-debug.h"
 #include "../cfs/cfs.h"
 #include "my_malloc.h"
+#include "../sfs-prof.h"
+#include <stdint.h>
 
 #ifndef SUCCESS
     #define SUCCESS         1       // a positive value, to indicate success
@@ -21,6 +23,38 @@
 
 // the system-wide max number of open files; defines open-file-cache size
 #define MAX_NB_OPEN_FILES       8
+// the system-wide max number of shm files; defines shm_pool size
+// (should be at least the front-end MAX_NB_FILES)
+#define MAX_NB_SHM_FILES        5
+// the number of name table buckets (a power of two); files with consecutive
+// single-character names each get their own bucket, up to SHM_NB_BUCKETS files
+#ifndef SHM_NB_BUCKETS
+    #define SHM_NB_BUCKETS          8
+#endif
+
+// files grow past their end in steps of SHM_GROW_STEP bytes (a power of two),
+// to avoid a realloc on every appended byte
+#ifndef SHM_GROW_STEP
+    #define SHM_GROW_STEP           8
+#endif
+
+// select the segregated-fit allocator (constant time) instead of first-fit
+#ifdef SHM_SEG_MALLOC
+    #define SHM_MALLOC(size)        seg_malloc(size)
+    #define SHM_REALLOC(ptr, size)  seg_realloc(ptr, size)
+    #define SHM_MALLOC_SIZE(ptr)    seg_malloc_size(ptr)
+    #define SHM_FREE(ptr)           seg_free(ptr)
+    #define SHM_INIT_MALLOC()       init_seg_lists()
+    // size classes are never merged, so there's nothing to compact
+    #define SHM_COMPACT()           0
+#else
+    #define SHM_MALLOC(size)        my_malloc(size)
+    #define SHM_REALLOC(ptr, size)  my_realloc(ptr, size)
+    #define SHM_MALLOC_SIZE(ptr)    my_malloc_size(ptr)
+    #define SHM_FREE(ptr)           my_free(ptr)
+    #define SHM_INIT_MALLOC()       init_free_list()
+    #define SHM_COMPACT()           my_compact(shm_relocate)
+#endif
 
 // ############################ DATA STRUCTURES ##############################
 
@@ -36,18 +70,56 @@ struct shm_entry {
     struct shm_entry *next;         // 2 bytes
 };
 
-struct shm_entry SM_D("sfs") *shm_list;
+// statically sized metadata pools, such that opening and closing a file
+// doesn't allocate anything from (nor fragment) the malloc data buffer
+struct shm_entry SM_D("sfs") shm_pool[MAX_NB_SHM_FILES];
+struct open_shm_entry SM_D("sfs") open_shm_pool[MAX_NB_OPEN_FILES];
+
+// index with SHM_BUCKET(name); chains the shm_entry structs through their next ptr
+struct shm_entry SM_D("sfs") *shm_table[SHM_NB_BUCKETS];
+struct shm_entry SM_D("sfs") *free_shm_list;
+// index with fd; points to the corresponding open_shm_pool entry when in use
 struct open_shm_entry SM_D("sfs") *open_fd_cache[MAX_NB_OPEN_FILES];
+// stack of the file descriptors not in use
+signed char SM_D("sfs") free_fd_stack[MAX_NB_OPEN_FILES];
+int SM_D("sfs") nb_free_fds;
+// current and high-water number of shm_pool entries in use; high-water fds
+unsigned int SM_D("sfs") nb_shm_used, max_shm_used, max_fds_used;
+
+// indicates the pools are intialized; set to false (zero) on SM creation
+char SM_D("sfs") SHM_INIT_DONE;
 
 // ############################ HELPER FUNCTIONS   ##############################
 
-#define CHK_MALLOC(ptr) \
-    if (!ptr) \
-    { \
-        printerror("running out of malloc space; returning..."); \
-        return FAILURE; \
+#define DO_SHM_INIT() \
+    if (!SHM_INIT_DONE) { \
+        cfs_format(); \
     }
 
+#define SHM_BUCKET(name)    (((unsigned char) (name)) & (SHM_NB_BUCKETS - 1))
+
+#define FOR_EACH_SHM(b, cur) \
+    for (b = 0; b < SHM_NB_BUCKETS; b++) \
+        for (cur = shm_table[b]; cur != NULL; cur = cur->next)
+
+#define ALLOC_SHM(e) \
+do { \
+    e = free_shm_list; \
+    if (e) \
+    { \
+        free_shm_list = e->next; \
+        if (++nb_shm_used > max_shm_used) \
+            max_shm_used = nb_shm_used; \
+    } \
+} while(0)
+
+#define FREE_SHM(e) \
+do { \
+    e->next = free_shm_list; \
+    free_shm_list = e; \
+    nb_shm_used--; \
+} while(0)
+
 #define CHK_FD(fd) \
     if (fd < 0 || fd >= MAX_NB_OPEN_FILES || !open_fd_cache[fd]) \
     { \
@@ -55,22 +127,90 @@ struct open_shm_entry SM_D("sfs") *open_fd_cache[MAX_NB_OPEN_FILES];
         return FAILURE; \
     }
 
+// the number of bytes that can be transferred from the current offset
+#define CLAMP_LEN(e, len) \
+    (((len) < (e)->shm->size - (e)->offset) ? (len) : ((e)->shm->size - (e)->offset))
+
+/*
+ * Copies n bytes; uses 16-bit word moves when both ends are word aligned.
+ * (libc memcpy lives outside the SM and can't be called on protected data.)
+ */
+void SM_F("sfs") shm_copy(void *dst, const void *src, unsigned int n)
+{
+    unsigned char *d = dst;
+    const unsigned char *s = src;
+    
+    if (!(((intptr_t) d | (intptr_t) s) & 0x1))
+    {
+        unsigned int *dw = (unsigned int *) d;
+        const unsigned int *sw = (const unsigned int *) s;
+        for (; n >= sizeof(unsigned int); n -= sizeof(unsigned int))
+            *dw++ = *sw++;
+        d = (unsigned char *) dw;
+        s = (const unsigned char *) sw;
+    }
+    
+    while (n--)
+        *d++ = *s++;
+}
+
+/*
+ * Called by the allocator for every malloc block moved during compaction. Open
+ * fds only reference the shm_entry, so only its malloc_ptr needs updating.
+ */
+void SM_F("sfs") shm_relocate(void *old_ptr, void *new_ptr)
+{
+    struct shm_entry *cur; int b;
+    FOR_EACH_SHM(b, cur)
+        if (cur->malloc_ptr == old_ptr)
+        {
+            cur->malloc_ptr = new_ptr;
+            return;
+        }
+}
+
+/*
+ * Extends the file to new_size bytes; the malloc block is grown in place when
+ * possible, else moved (open fds only reference the shm_entry). On failure the
+ * file keeps its current size, such that a write is cut short.
+ */
+void SM_F("sfs") shm_grow(struct shm_entry *shm, unsigned int new_size)
+{
+    if (new_size > SHM_MALLOC_SIZE(shm->malloc_ptr))
+    {
+        unsigned char *p = SHM_REALLOC(shm->malloc_ptr,
+            (new_size + SHM_GROW_STEP - 1) & ~(SHM_GROW_STEP - 1));
+        if (!p)
+            p = SHM_REALLOC(shm->malloc_ptr, new_size);
+        // defragment the buffer and retry before giving up
+        if (!p && SHM_COMPACT())
+            p = SHM_REALLOC(shm->malloc_ptr, new_size);
+        if (!p)
+        {
+            printerror_int("running out of malloc space to grow to %d bytes", new_size);
+            return;
+        }
+        if (p != shm->malloc_ptr)
+        {
+            SFS_PROF_PATH(SFS_PATH_MOVE)
+        }
+        shm->malloc_ptr = p;
+    }
+    shm->size = new_size;
+}
+
 int SM_F("sfs") open_existing_file(struct shm_entry *shm)
 {
-    // locate a free file descriptor
-    int i;
-    for (i = 0; i < MAX_NB_OPEN_FILES; i++)
-        if (!open_fd_cache[i])
-            break;
-            
-    if (i == MAX_NB_OPEN_FILES)
+    if (!nb_free_fds)
     {
         printerror("there are no shm back-end file descriptors left; returning...");
         return FAILURE;
     }
+    int i = free_fd_stack[--nb_free_fds];
+    if (MAX_NB_OPEN_FILES - nb_free_fds > max_fds_used)
+        max_fds_used = MAX_NB_OPEN_FILES - nb_free_fds;
     
-    struct open_shm_entry *e = my_malloc(sizeof(struct open_shm_entry)+1); //TODO malloc bug +1
-    CHK_MALLOC(e);
+    struct open_shm_entry *e = &open_shm_pool[i];
     e->shm = shm;
     e->offset = 0;
     open_fd_cache[i] = e;
@@ -85,20 +225,25 @@ int SM_F("sfs") cfs_format(void)
     printdi_debug("sizeof struct shm_entry is %d", sizeof(struct shm_entry));
     printdi_debug("sizeof struct open_shm_entry is %d", sizeof(struct open_shm_entry));    
     
-    struct shm_entry *cur, *next;
-    for (cur = shm_list; cur != NULL; cur = next)
-    {
-        my_free(cur->malloc_ptr);
-        next = cur->next;
-        my_free(cur);
-    }
-    shm_list = NULL;
-    
+    // populate free_shm_list linked list; any existing file is discarded
     int i;
-    for (i = 0; i < MAX_NB_OPEN_FILES; i++)
+    for (i = 0; i < SHM_NB_BUCKETS; i++)
+        shm_table[i] = NULL;
+    free_shm_list = NULL;
+    for (i = MAX_NB_SHM_FILES - 1; i >= 0; i--)
+        FREE_SHM((&shm_pool[i]));
+    nb_shm_used = max_shm_used = max_fds_used = 0;
+    
+    // the lowest fd ends up on top of the stack
+    nb_free_fds = 0;
+    for (i = MAX_NB_OPEN_FILES - 1; i >= 0; i--)
+    {
         open_fd_cache[i] = NULL;
+        free_fd_stack[nb_free_fds++] = i;
+    }
     
-    init_free_list();
+    SHM_INIT_MALLOC();
+    SHM_INIT_DONE = 1;
     
     return SUCCESS;
 }
@@ -107,9 +252,9 @@ void SM_F("sfs") cfs_dump(void)
 {
     struct shm_entry *cur; int i;
 
-    printd_info(FCT("cfs_dump") "dumping shm_entry linked list:");
+    printd_info(FCT("cfs_dump") "dumping shm_entry name table:");
     puts("\t----------------------------------------------------------------");
-    for (cur = shm_list; cur != NULL; cur = cur->next)
+    FOR_EACH_SHM(i, cur)
     {
         printf_int(BOLD "\tSHM_ENTRY" NONE " with name '%c' ", cur->name);
         printf_int("at %#x; ", (intptr_t) cur);
@@ -131,61 +276,82 @@ void SM_F("sfs") cfs_dump(void)
             printf_str("); ");
     }    
     printf_str("\n");
+
+#ifndef SHM_SEG_MALLOC
+    struct malloc_stats stats;
+    my_malloc_stats(&stats);
+    printf_int_int("\tmalloc: %d free bytes in %d chunks; ", stats.free_bytes,
+        stats.nb_free_chunks);
+    printf_int_int("largest %d; fragmentation %d%%\n", stats.largest_free,
+        MALLOC_FRAGMENTATION(stats));
+#endif
 }
 
 int SM_F("sfs") cfs_open(const char *name, int flags, unsigned int size)
 {
+    SFS_PROF_SCOPE(SFS_LAYER_CFS)
     char the_name = *name;
+    DO_SHM_INIT()
     
     // check whether already exists
     struct shm_entry *cur;
-    for (cur = shm_list; cur != NULL; cur = cur->next)
+    for (cur = shm_table[SHM_BUCKET(the_name)]; cur != NULL; cur = cur->next)
         if (cur->name == the_name)
             return open_existing_file(cur);
     
-    // request malloc block of desired size
-    void *the_shm_block = my_malloc(size);
-    CHK_MALLOC(the_shm_block)
-    
-    // insert new shm_entry struct in front
-    cur = my_malloc(sizeof(struct shm_entry)+1); //TODO malloc bug +1
+    ALLOC_SHM(cur);
     if (!cur)
     {
-        printerror("not enough malloc space left for internal data structures; returning...");
-        my_free(the_shm_block);
+        printerror("no more shm_entry structs left; returning...");
+        return FAILURE;
+    }
+    
+    // request malloc block of desired size
+    void *the_shm_block = SHM_MALLOC(size);
+    if (!the_shm_block && SHM_COMPACT())
+        the_shm_block = SHM_MALLOC(size);
+    if (!the_shm_block)
+    {
+        printerror("running out of malloc space; returning...");
+        FREE_SHM(cur);
         return FAILURE;
     }
+    
     cur->name = the_name;
     cur->malloc_ptr = the_shm_block;
     cur->size = size;
-    cur->next = shm_list;
-    shm_list = cur;
     
     int fd = open_existing_file(cur);
     if (fd == FAILURE)
     {
         printerror("could not open the new file; returning...");
-        my_free(the_shm_block);
-        my_free(cur);
+        SHM_FREE(the_shm_block);
+        FREE_SHM(cur);
         return FAILURE;
     }
+    
+    // insert new shm_entry struct in front of its bucket
+    cur->next = shm_table[SHM_BUCKET(the_name)];
+    shm_table[SHM_BUCKET(the_name)] = cur;
     return fd;
 }
 
 void SM_F("sfs") cfs_close(int fd)
 {
+    SFS_PROF_SCOPE(SFS_LAYER_CFS)
     if (fd < 0 || fd >= MAX_NB_OPEN_FILES || !open_fd_cache[fd])
     {
         printdi_warning("provided shm back-end fd %d invalid for closing; returning...", fd);
         return;
     }
     
-    my_free(open_fd_cache[fd]);
     open_fd_cache[fd] = NULL;
+    free_fd_stack[nb_free_fds++] = fd;
 }
 
 int SM_F("sfs") cfs_read(int fd, void *buf, unsigned int len)
 {
+    SFS_PROF_SCOPE(SFS_LAYER_CFS)
     CHK_FD(fd);
     
     struct open_shm_entry *cur = open_fd_cache[fd];
@@ -195,31 +361,38 @@ int SM_F("sfs") cfs_read(int fd, void *buf, unsigned int len)
         return EOF;
     }
     
-    // TODO ignore the length argument for now and always read one char
-    char *buff = (char *) buf;
-    *buff = *(cur->shm->malloc_ptr + cur->offset++);
-    return 1;
+    // a partial read returns the bytes left before EOF
+    unsigned int n = CLAMP_LEN(cur, len);
+    shm_copy(buf, cur->shm->malloc_ptr + cur->offset, n);
+    cur->offset += n;
+    return n;
 }
 
 int SM_F("sfs") cfs_write(int fd, const void *buf, unsigned int len)
 {
+    SFS_PROF_SCOPE(SFS_LAYER_CFS)
     CHK_FD(fd);
     
+    // writes past the end extend the file
     struct open_shm_entry *cur = open_fd_cache[fd];
+    if (cur->offset + len > cur->shm->size)
+        shm_grow(cur->shm, cur->offset + len);
+    
     if (cur->offset >= cur->shm->size)
     {
         printdi_warning("reached EOF for file descriptor %d", fd);
         return EOF;
     }
     
-    // TODO ignore the length argument for now and always read one char
-    char *buff = (char *) buf;
-    *(cur->shm->malloc_ptr + cur->offset++) = *buff;
-    return 1;
+    unsigned int n = CLAMP_LEN(cur, len);
+    shm_copy(cur->shm->malloc_ptr + cur->offset, buf, n);
+    cur->offset += n;
+    return n;
 }
 
 cfs_offset_t SM_F("sfs") cfs_seek(int fd, cfs_offset_t offset, int whence)
 {
+    SFS_PROF_SCOPE(SFS_LAYER_CFS)
     CHK_FD(fd);
     struct open_shm_entry *fdp = open_fd_cache[fd];
     cfs_offset_t new_offset;
@@ -234,7 +407,8 @@ cfs_offset_t SM_F("sfs") cfs_seek(int fd, cfs_offset_t offset, int whence)
         return (cfs_offset_t)-1;
     }    
     
-    if (new_offset < 0 || new_offset >= fdp->shm->size)
+    // seeking to the end is allowed, to append to the file
+    if (new_offset < 0 || new_offset > fdp->shm->size)
     {
         printerror_int("calculated new_offset '%d' is out of range", new_offset);
         return (cfs_offset_t)-1;
@@ -247,21 +421,24 @@ cfs_offset_t SM_F("sfs") cfs_seek(int fd, cfs_offset_t offset, int whence)
 // the front-end ensures a logical file is not removed when there are still open fds
 int SM_F("sfs") cfs_remove(const char *name)
 {
+    SFS_PROF_SCOPE(SFS_LAYER_CFS)
     char the_name = *name;
+    struct shm_entry **head = &shm_table[SHM_BUCKET(the_name)];
     struct shm_entry *cur, *prev;
-    for (cur = prev = shm_list; cur != NULL; prev = cur, cur = cur->next)
+    for (cur = prev = *head; cur != NULL; prev = cur, cur = cur->next)
         if (cur->name == the_name)
         {
             prev->next = cur->next;
-            if (cur == shm_list)
-                shm_list = cur->next;
+            if (cur == *head)
+                *head = cur->next;
                 
             // TODO the implementation could zero-out the memory before freeing
             /*int i;
             for (i = 0; i < cur->size; i++)
                 cur->malloc_ptr[i] = 0;
             */
-            my_free(cur);
+            SHM_FREE(cur->malloc_ptr);
+            FREE_SHM(cur);
             return SUCCESS;
         }
     
@@ -269,6 +446,28 @@ int SM_F("sfs") cfs_remove(const char *name)
     return SUCCESS;
 }
 
+void SM_F("sfs") cfs_usage(int resource, struct cfs_usage *usage, int reset)
+{
+    DO_SHM_INIT()
+    usage->cur = usage->max = usage->size = 0;
+    if (resource == CFS_USAGE_FILES)
+    {
+        usage->cur = nb_shm_used;
+        usage->max = max_shm_used;
+        usage->size = MAX_NB_SHM_FILES;
+        if (reset)
+            max_shm_used = nb_shm_used;
+    }
+    else if (resource == CFS_USAGE_FDS)
+    {
+        usage->cur = MAX_NB_OPEN_FILES - nb_free_fds;
+        usage->max = max_fds_used;
+        usage->size = MAX_NB_OPEN_FILES;
+        if (reset)
+            max_fds_used = usage->cur;
+    }
+}
+
 int SM_F("sfs") cfs_opendir(struct cfs_dir *dirp, const char *name)
 {
     return -1;
@@ -0,0 +1,134 @@
+/**
+ * A host-side decoder for the binary TSC record stream of a TSC_BINARY build
+ * (see benchmark.h), turning a captured UART log or a host build's stdout into
+ * CSV or JSON. Text output interleaved with the records is skipped, or echoed
+ * to stderr with -t.
+ *
+ * usage: tsc-decode [-j] [-t] [log]
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+// keep in sync with benchmark.h
+#define TSC_TAG_LABEL           0xA0
+#define TSC_TAG_SAMPLE          0xA1
+#define TSC_TAG_END             0xA2
+
+#define MAX_LABELS              256
+#define MAX_LABEL_LENGTH        128
+
+char labels[MAX_LABELS][MAX_LABEL_LENGTH];
+
+int json, echo_text;
+int nb_records;
+
+int read_varint(FILE *in, uint32_t *v)
+{
+    int c, shift = 0;
+    *v = 0;
+    do
+    {
+        if ((c = getc(in)) == EOF || shift > 28)
+            return 0;
+        *v |= (uint32_t) (c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+    return 1;
+}
+
+// quotes the label as a CSV field or a JSON string
+void print_label(const char *label)
+{
+    putchar('"');
+    for (; *label; label++)
+    {
+        if (*label == '"')
+            putchar(json ? '\\' : '"');
+        else if (*label == '\\' && json)
+            putchar('\\');
+        putchar(*label);
+    }
+    putchar('"');
+}
+
+void print_sample(int run, uint32_t id, uint32_t cycles)
+{
+    const char *label = (id < MAX_LABELS && labels[id][0]) ? labels[id] : "?";
+    if (json)
+    {
+        printf("%s\n  {\"run\": %d, \"label\": ", nb_records ? "," : "", run);
+        print_label(label);
+        printf(", \"cycles\": %lu}", (unsigned long) cycles);
+    }
+    else
+    {
+        printf("%d,", run);
+        print_label(label);
+        printf(",%lu\n", (unsigned long) cycles);
+    }
+    nb_records++;
+}
+
+int main(int argc, char **argv)
+{
+    FILE *in = stdin;
+    int i, c, run = 0;
+    uint32_t id, cycles;
+
+    for (i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "-j"))
+            json = 1;
+        else if (!strcmp(argv[i], "-t"))
+            echo_text = 1;
+        else if (!(in = fopen(argv[i], "rb")))
+        {
+            perror(argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf(json ? "[" : "run,label,cycles\n");
+    while ((c = getc(in)) != EOF)
+    {
+        switch (c)
+        {
+            case TSC_TAG_LABEL:
+                if (!read_varint(in, &id))
+                    goto truncated;
+                for (i = 0; (c = getc(in)) != EOF && c; i++)
+                    if (id < MAX_LABELS && i < MAX_LABEL_LENGTH - 1)
+                        labels[id][i] = c;
+                if (c == EOF)
+                    goto truncated;
+                if (id < MAX_LABELS)
+                    labels[id][i < MAX_LABEL_LENGTH ? i : MAX_LABEL_LENGTH - 1] = '\0';
+                break;
+
+            case TSC_TAG_SAMPLE:
+                if (!read_varint(in, &id) || !read_varint(in, &cycles))
+                    goto truncated;
+                print_sample(run, id, cycles);
+                break;
+
+            case TSC_TAG_END:
+                run++;
+                break;
+
+            default:
+                if (c >= 0x80)
+                    fprintf(stderr, "tsc-decode: skipping unknown tag 0x%x\n", c);
+                else if (echo_text)
+                    fputc(c, stderr);
+        }
+    }
+    printf(json ? "\n]\n" : "");
+    return EXIT_SUCCESS;
+
+truncated:
+    fprintf(stderr, "tsc-decode: truncated record at end of input\n");
+    printf(json ? "\n]\n" : "");
+    return EXIT_FAILURE;
+}